@@ -1,86 +1,153 @@
-#include <stdint.h>
-#include <iostream>
-#include <hls_stream.h>
-#include <ap_axi_sdata.h>
-#include <hls_video.h>
-#include <math.h>
-#include <ap_fixed.h>
-
-#define WIDTH  1920
-#define HEIGHT 1080 
-//#define WIDTH  1280 for simulation
-//#define HEIGHT 720 for simulation
-#define HIGH 80
-#define LOW 20
-#define WEAK 75
-#define STRONG 255
-#define CORDIC_ITERATIONS 10
+#include "canny.h"
 
 // Authors: Group 3
 // Course: Reconfigurable Computing
 
-typedef ap_axiu<32,1,1,1> pixel_data;
-typedef hls::stream<pixel_data> pixel_stream;
-typedef uint8_t linebuffer2[2][WIDTH];
-typedef uint8_t linebuffer4[4][WIDTH];
-typedef int16_t linebuffer[2][WIDTH];
-typedef uint8_t windowbuffer3[3][3];
-typedef uint8_t windowbuffer5[5][5];
-typedef ap_uint<1> data_bool;
-
 const int8_t kxy[6][3] = {{-1,0,1},{-2,0,2},{-1,0,1},{1,2,1},{0,0,0},{-1,-2,-1}};
 const uint8_t gauss_kernel[25]={1,4,7,4,1,4,16,26,16,4,7,26,41,26,7,4,16,26,16,4,1,4,7,4,1};
+#if GAUSS_SIZE == 3
+const uint8_t gauss_binomial[3]={1,2,1};
+#elif GAUSS_SIZE == 5
+const uint8_t gauss_binomial[5]={1,4,6,4,1};
+#elif GAUSS_SIZE == 7
+const uint8_t gauss_binomial[7]={1,6,15,20,15,6,1};
+#elif GAUSS_SIZE == 9
+const uint8_t gauss_binomial[9]={1,8,28,56,70,56,28,8,1};
+#elif GAUSS_SIZE
+#error "GAUSS_SIZE must be 0, 3, 5, 7 or 9"
+#endif
 const uint8_t angle_step[10]={45,27,14,7,3,2,1,0,0,0};
 
-inline data_bool bound(int16_t row, int16_t col, int8_t i, int8_t j){
-	return (row+i)>=0 && (row+i)<HEIGHT && (col+j)>=0 && (col+j)<WIDTH;
+inline data_bool bound(int16_t row, int16_t col, int8_t i, int8_t j, uint16_t width, uint16_t height){
+	return (row+i)>=0 && (row+i)<height && (col+j)>=0 && (col+j)<width;
 }
 
-inline void set_pixel(pixel_data& p, uint8_t intensity){
+// Pixel accessors of both stream formats, for any TDEST width
+template<int TD>
+inline void set_pixel(ap_axiu<32,1,1,TD>& p, uint8_t intensity){
 	p.data = (p.data & 0xFF000000) |(intensity << 16) | (intensity << 8) | intensity ;
 }
 
-inline uint8_t get_value(pixel_data& p){
+template<int TD>
+inline void set_pixel(ap_axiu<8,3,1,TD>& p, uint8_t intensity){
+	p.data = intensity;
+}
+
+template<int TD>
+inline uint8_t get_value(ap_axiu<32,1,1,TD>& p){
 	return p.data & 0x000000FF;
 }
 
-inline void read_pixel(pixel_stream &src, pixel_data& p, uint16_t& x, uint16_t& y){
-	src >> p;
-	if (p.user)
-		x = y = 0;
+template<int TD>
+inline uint8_t get_value(ap_axiu<8,3,1,TD>& p){
+	return p.data;
 }
 
-inline void write_pixel(pixel_stream &dst, pixel_data& p, uint16_t& x, uint16_t& y){
-	if (p.last){
-		x = 0;
-		y++;
-	}
-	else
-		x++;
-	dst << p;
+template<int TD>
+inline void set_dir(ap_axiu<32,1,1,TD>& p, direction d){
+	p.data = (p.data & 0xFCFFFFFF) | ((uint32_t) d << 24);
+}
+
+template<int TD>
+inline void set_dir(ap_axiu<8,3,1,TD>& p, direction d){
+	p.user = (p.user & 1) | ((uint8_t) d << 1);
 }
 
-inline void update5(linebuffer4& buffer, windowbuffer5& window, pixel_data& p, uint16_t x){
+template<int TD>
+inline direction get_dir(ap_axiu<32,1,1,TD>& p){
+	return (p.data >> 24) & 3;
+}
 
-	uint8_t tmp[5];
-	tmp[0] = buffer[0][x];
-	for (uint8_t i = 1; i < 4; i++){
-		buffer[i-1][x] = buffer[i][x];
-		tmp[i] = buffer[i-1][x];
+template<int TD>
+inline direction get_dir(ap_axiu<8,3,1,TD>& p){
+	return p.user >> 1;
+}
+
+// Drop the direction once suppression consumed it, RGBA gets its opaque alpha back
+template<int TD>
+inline void clear_dir(ap_axiu<32,1,1,TD>& p){
+	p.data = p.data | 0x03000000;
+}
+
+template<int TD>
+inline void clear_dir(ap_axiu<8,3,1,TD>& p){
+	p.user = p.user & 1;
+}
+
+// Copy the side channels and intensity into a pixel of another stream format
+template<typename TI, typename TO>
+inline void convert(TI& p, TO& q){
+	q.keep = -1;
+	q.strb = -1;
+	q.user = p.user;
+	q.last = p.last;
+	q.id = p.id;
+	q.dest = p.dest;
+	q.data = 0xFF000000;
+	set_pixel(q, get_value(p));
+}
+
+template<int TD>
+inline void convert(ap_axiu<32,1,1,TD>& p, ap_axiu<32,1,1,TD>& q){
+	q = p;
+}
+
+// A cycle without an input beat or without room for the output beat stalls
+// the stage
+template<typename TI, typename TO>
+inline data_bool stalled(hls::stream<TI> &src, hls::stream<TO> &dst, perf_counters& counters){
+	if (src.empty()){
+		counters.stall_in++;
+		return 1;
+	}
+	if (dst.full()){
+		counters.stall_out++;
+		return 1;
 	}
+	return 0;
+}
 
-	buffer[3][x] = get_value(p);
-	tmp[4] = buffer[3][x];
+// Line buffer bank of the stream a beat belongs to, TDEST in the
+// multi-camera mode
+template<int K, typename T>
+inline uint8_t bank(T& p){
+	return (K > 1) ? (uint8_t) p.dest : 0;
+}
 
-	for (uint8_t i= 0; i < 5; i++)
-		for (uint8_t j = 0; j < 4; j++)
-			window[i][j] = window[i][j + 1];
+template<typename T>
+inline void count_pixel(T& p, uint16_t& x, uint16_t& y, perf_counters& counters, uint16_t n = 1){
+	if (p.user[0]){
+		counters.frames++;
+		if (x != 0)
+			counters.errors++;
+		x = y = 0;
+	}
+	if (p.last){
+		if (y != 0 && x + n != counters.line)
+			counters.errors++;
+		counters.line = x + n;
+	}
+	counters.pixels += n;
+}
 
-	for (uint8_t i = 0; i < 5; i++)
-		window[i][4] = tmp[i];
+template<typename T>
+inline void read_pixel(hls::stream<T> &src, T& p, uint16_t& x, uint16_t& y, perf_counters& counters, uint16_t n = 1){
+	src >> p;
+	count_pixel(p, x, y, counters, n);
+}
+
+template<typename T>
+inline void write_pixel(hls::stream<T> &dst, T& p, uint16_t& x, uint16_t& y, uint16_t n = 1){
+	if (p.last){
+		x = 0;
+		y++;
+	}
+	else
+		x += n;
+	dst << p;
 }
 
-inline void update3(linebuffer2& buffer, windowbuffer3& window, pixel_data& p, uint16_t x){
+inline void update3(linebuffer2& buffer, windowbuffer3& window, uint8_t value, uint16_t x){
 
 	uint8_t tmp[3];
 	tmp[0] = buffer[0][x];
@@ -88,7 +155,7 @@ inline void update3(linebuffer2& buffer, windowbuffer3& window, pixel_data& p, u
 	buffer[0][x] = buffer[1][x];
 	tmp[1] = buffer[0][x];
 
-	buffer[1][x] = get_value(p);
+	buffer[1][x] = value;
 	tmp[2] = buffer[1][x];
 
 	for (uint8_t i= 0; i < 3; i++)
@@ -99,36 +166,35 @@ inline void update3(linebuffer2& buffer, windowbuffer3& window, pixel_data& p, u
 		window[i][2] = tmp[i];
 }
 
-inline void update_angle(int16_t angle, linebuffer& angle_buff, uint16_t x){
-	angle_buff[0][x] = angle_buff[1][x];
-	angle_buff[1][x] = angle;
+inline void update_dir(direction dir, dirbuffer& dir_buff, uint16_t x){
+	dir_buff[0][x] = dir_buff[1][x];
+	dir_buff[1][x] = dir;
 }
 
-inline int16_t convolute(windowbuffer3& window, uint16_t x, uint16_t y, data_bool mask){
+inline int16_t convolute(windowbuffer3& window, uint16_t x, uint16_t y, data_bool mask, uint16_t width, uint16_t height){
 
 	int16_t result = 0;
 	int16_t cy=y-1, cx=x-1;
 	for(int8_t i=-1; i<2; i++){
 		for(int8_t j=-1; j<2; j++){
-			if(bound(cy, cx, i, j))
+			if(bound(cy, cx, i, j, width, height))
 				result += (int16_t) window[i+1][j+1] * kxy[i+1+(mask?3:0)][j+1];
 		}
 	}
 	return result;
 }
 
-inline int16_t sobel_v1(int16_t i_x, int16_t i_y, pixel_data& p){
+inline int16_t sobel_v1(int16_t i_x, int16_t i_y, uint8_t& intensity){
 
 	int32_t sqr1 = i_x * i_x;
 	int32_t sqr2 = i_y * i_y;
 	int32_t sum = sqr1 + sqr2;
-	uint8_t intensity = (uint8_t) hls::sqrt(sum);
-	set_pixel(p, intensity);
+	intensity = (uint8_t) hls::sqrt(sum);
 
 	return (int16_t) (hls::atan2(i_y, i_x) * 180 / M_PI);
 }
 
-inline int16_t sobel_v2(int16_t i_x, int16_t i_y, pixel_data& p){
+inline int16_t sobel_v2(int16_t i_x, int16_t i_y, uint8_t& intensity){
 
 	int16_t atan=0;
 	int16_t x_cordic[CORDIC_ITERATIONS],y_cordic[CORDIC_ITERATIONS];
@@ -150,234 +216,421 @@ inline int16_t sobel_v2(int16_t i_x, int16_t i_y, pixel_data& p){
 	uint16_t intensity_interim=(x_cordic[CORDIC_ITERATIONS-1]>=0)?x_cordic[CORDIC_ITERATIONS-1]:-x_cordic[CORDIC_ITERATIONS-1];
 
 	//multiply with a constant 0.6094
-	uint8_t intensity = (uint8_t) ((intensity_interim>>1)+(intensity_interim>>2)-(intensity_interim>>3)-
+	intensity = (uint8_t) ((intensity_interim>>1)+(intensity_interim>>2)-(intensity_interim>>3)-
 			(intensity_interim>>4)+(intensity_interim>>5)+(intensity_interim>>6));
 
-	set_pixel(p, intensity);
-
 	return atan;
 }
 
-void greyscale(pixel_stream &src, pixel_stream &dst){
-#pragma HLS INTERFACE ap_ctrl_none port=return
-#pragma HLS INTERFACE axis port=&src
-#pragma HLS INTERFACE axis port=&dst
-#pragma HLS PIPELINE II=1
-#pragma HLS inline region recursive
+// NMS sector straight from the gradient signs and a shift-add compare of
+// |Gy| against tan(22.5)*|Gx|, approximated by 53/128
+inline direction sobel_sector(int16_t i_x, int16_t i_y){
 
-	static uint16_t x = 0;
-	static uint16_t y = 0;
-	pixel_data p;
+	uint16_t abs_x = (i_x >= 0) ? i_x : -i_x;
+	uint16_t abs_y = (i_y >= 0) ? i_y : -i_y;
+	uint32_t tan_x = (abs_x<<5) + (abs_x<<4) + (abs_x<<2) + abs_x;
+	uint32_t tan_y = (abs_y<<5) + (abs_y<<4) + (abs_y<<2) + abs_y;
 
-	read_pixel(src, p, x, y);
+	if(((uint32_t) abs_y<<7) <= tan_x)
+		return 0;
+	else if(((uint32_t) abs_x<<7) <= tan_y)
+		return 2;
+	else
+		return ((i_x >= 0) == (i_y >= 0)) ? 1 : 3;
+}
 
-	uint8_t r,g,b,a;
-	r= (uint8_t) (p.data)&0x000000FF;
-	g= (uint8_t) (p.data>>8)&0x000000FF;
-	b= (uint8_t) (p.data>>16)&0x000000FF;
-	a= (uint8_t) (p.data>>24)&0x000000FF;
-	uint8_t intensity = (r>>2) + (r>>5) + (b>>4) + (b>>5)+ (g>>1) + (g>>4);
+inline direction sobel_v3(int16_t i_x, int16_t i_y, uint8_t& intensity){
 
-	set_pixel(p, intensity);
+	int32_t sum = i_x * i_x + i_y * i_y;
+	intensity = (uint8_t) hls::sqrt(sum);
 
-	write_pixel(dst, p, x, y);
+	return sobel_sector(i_x, i_y);
 }
 
-void gauss(pixel_stream &src, pixel_stream &dst){
-#pragma HLS INTERFACE ap_ctrl_none port=return
-#pragma HLS INTERFACE axis port=&src
-#pragma HLS INTERFACE axis port=&dst
-#pragma HLS PIPELINE II=1
-#pragma HLS inline region recursive
+// |Gx|+|Gy|, an adder in place of the squares and the square root
+inline direction sobel_v4(int16_t i_x, int16_t i_y, uint8_t& intensity){
 
-	static uint16_t x = 0;
-	static uint16_t y = 0;
-	static linebuffer4 buffer;
-	static windowbuffer5 window;
-	pixel_data p;
+	uint16_t abs_x = (i_x >= 0) ? i_x : -i_x;
+	uint16_t abs_y = (i_y >= 0) ? i_y : -i_y;
+	uint16_t sum = abs_x + abs_y;
+	intensity = (sum > 255) ? 255 : sum;
+
+	return sobel_sector(i_x, i_y);
+}
+
+// Alpha max plus beta min, 15/16 max + 15/32 min in shifts and adds,
+// within 6.2% of the Euclidean magnitude
+inline direction sobel_v5(int16_t i_x, int16_t i_y, uint8_t& intensity){
 
-	read_pixel(src, p, x, y);
+	uint16_t abs_x = (i_x >= 0) ? i_x : -i_x;
+	uint16_t abs_y = (i_y >= 0) ? i_y : -i_y;
+	uint16_t big = (abs_x > abs_y) ? abs_x : abs_y;
+	uint16_t small = (abs_x > abs_y) ? abs_y : abs_x;
+	uint16_t sum = big - (big>>4) + (small>>1) - (small>>5);
+	intensity = (sum > 255) ? 255 : sum;
 
-#pragma HLS ARRAY_PARTITION variable=buffer complete dim=1
-#pragma HLS ARRAY_PARTITION variable=window complete dim=0
-#pragma HLS dependence variable=buffer inter false
+	return sobel_sector(i_x, i_y);
+}
+
+// HIGH and LOW on the scale of the magnitude of the mask: |Gx|+|Gy| is
+// 4/pi of the Euclidean magnitude on average over the angle, alpha max plus
+// beta min 1.02 of it
+inline uint8_t scale_threshold(uint8_t t, uint32_t mask){
+
+	uint16_t scaled = t;
+	if(mask == 3)
+		scaled = t + (t>>2) + (t>>5);
+	else if(mask == 4)
+		scaled = t + (t>>6);
+	return (scaled > 255) ? 255 : scaled;
+}
+
+// Per-pixel kernels of the stages. The stage functions below call them
+// once per pixel, the wide-beat variants once per lane with shared state.
+
+inline uint8_t greyscale_px(uint32_t data){
+
+	uint8_t r,g,b;
+	r= (uint8_t) (data)&0x000000FF;
+	g= (uint8_t) (data>>8)&0x000000FF;
+	b= (uint8_t) (data>>16)&0x000000FF;
+	return (r>>2) + (r>>5) + (b>>4) + (b>>5)+ (g>>1) + (g>>4);
+}
+
+// Shift a line buffer column up by one row, tmp receives the rows followed
+// by the new value
+template<int R>
+inline void shift_column(uint8_t column[R], uint8_t value, uint8_t tmp[R+1]){
+	for (uint8_t i = 0; i < R; i++)
+		tmp[i] = column[i];
+	tmp[R] = value;
+	for (uint8_t i = 0; i < R; i++)
+		column[i] = tmp[i+1];
+}
+
+#if GAUSS_SIZE
+// Vertical pass over the line buffer column, horizontal pass over the shift
+// register of column sums. Each pass sums to 2^(GAUSS_SIZE-1).
+inline uint8_t gauss_window_px(gauss_window& window, uint8_t column[GAUSS_SIZE], uint8_t value,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height){
+
+	const int8_t r = GAUSS_SIZE/2;
+	int16_t cy=y-r, cx=x-r;
+
+	// the column is at x, only its rows can fall outside the frame
+	uint16_t sum = 0;
+	for (int8_t i = 0; i < GAUSS_SIZE; i++)
+		if(bound(cy, x, i-r, 0, width, height))
+			sum += column[i] * gauss_binomial[i];
+
+	for (uint8_t j = 0; j < GAUSS_SIZE-1; j++)
+		window[j] = window[j+1];
+	window[GAUSS_SIZE-1] = sum;
+
+	if(x>=r && y>=r){
+		uint32_t result = 1 << (2*GAUSS_SIZE-3);
+		for (int8_t j = 0; j < GAUSS_SIZE; j++)
+			if(bound(cy, cx, 0, j-r, width, height))
+				result += window[j] * gauss_binomial[j];
+		return (uint8_t) (result >> (2*GAUSS_SIZE-2));
+	}
+	return value;
+}
+#else
+inline uint8_t gauss_window_px(gauss_window& window, uint8_t column[5], uint8_t value,
+		uint16_t x, uint16_t y, uint16_t width, uint16_t height){
+
+	for (uint8_t i= 0; i < 5; i++)
+		for (uint8_t j = 0; j < 4; j++)
+			window[i][j] = window[i][j + 1];
 
-	update5(buffer, window, p, x);
+	for (uint8_t i = 0; i < 5; i++)
+		window[i][4] = column[i];
 
 	if(x>1 && y>1){
 		int32_t result = 0;
 		int16_t cy=y-2, cx=x-2;
 		for(int8_t i=-2; i<3; i++){
 			for(int8_t j=-2; j<3; j++){
-				if(bound(cy, cx, i, j))
+				if(bound(cy, cx, i, j, width, height))
 					result += window[i+2][j+2] * gauss_kernel[(5*(j+2))+i+2];
 			}
 		}
 		result /= 273;
-		set_pixel(p, (uint8_t) result);
+		return (uint8_t) result;
 	}
-	write_pixel(dst, p, x, y);
+	return value;
 }
+#endif
 
+inline uint8_t gauss_px(gauss_linebuffer& buffer, gauss_window& window, uint8_t value, uint16_t x, uint16_t y,
+		uint16_t width, uint16_t height){
 
-int16_t sobel(pixel_stream &src, pixel_stream &dst, uint32_t mask){
-#pragma HLS INTERFACE ap_ctrl_none port=return
-#pragma HLS INTERFACE axis port=&src
-#pragma HLS INTERFACE axis port=&dst
-#pragma HLS INTERFACE s_axilite port=mask
-#pragma HLS PIPELINE II=1
-#pragma HLS inline region recursive
+	uint8_t column[GAUSS_ROWS], tmp[GAUSS_ROWS+1];
+	for (uint8_t i = 0; i < GAUSS_ROWS; i++)
+		column[i] = buffer[i][x];
+	shift_column<GAUSS_ROWS>(column, value, tmp);
+	for (uint8_t i = 0; i < GAUSS_ROWS; i++)
+		buffer[i][x] = column[i];
 
-	static uint16_t x = 0;
-	static uint16_t y = 0;
-	static linebuffer2 buffer;
-	static windowbuffer3 window;
-	int16_t angle = 0;
-	pixel_data p;
+	return gauss_window_px(window, tmp, value, x, y, width, height);
+}
 
-	read_pixel(src, p, x, y);
+// Sector of the gradient angle in degrees, folded to [0, 180)
+inline direction quantize_angle(int16_t angle){
+	if(angle < 0)
+		angle += 180;
+
+	if(angle <= 22 || angle >= 158)
+		return 0;
+	else if(angle <= 67)
+		return 1;
+	else if(angle <= 112)
+		return 2;
+	else
+		return 3;
+}
 
-#pragma HLS ARRAY_PARTITION variable=buffer complete dim=1
-#pragma HLS ARRAY_PARTITION variable=window complete dim=0
-#pragma HLS dependence variable=buffer inter false
+inline direction sobel_window_px(windowbuffer3& window, uint8_t& value, uint16_t x, uint16_t y,
+		uint32_t mask, uint16_t width, uint16_t height){
 
-	if(x>1 && y>1)
-		update3(buffer, window, p, x);
+	direction dir = 0;
 
 	if(y>2 && x>2){
-		int16_t i_x = convolute(window, x, y, 0);
-		int16_t i_y = convolute(window, x, y, 1);
+		int16_t i_x = convolute(window, x, y, 0, width, height);
+		int16_t i_y = convolute(window, x, y, 1, width, height);
 
 		if(mask == 0)
-			angle = sobel_v1(i_x, i_y, p);
-		else
-			angle = sobel_v2(i_x, i_y, p);
+			dir = quantize_angle(sobel_v1(i_x, i_y, value));
+		else if(mask == 1)
+			dir = quantize_angle(sobel_v2(i_x, i_y, value));
+		else if(mask == 3)
+			dir = sobel_v4(i_x, i_y, value);
+		else if(mask == 4)
+			dir = sobel_v5(i_x, i_y, value);
+		else // mask 2, and any value above 4
+			dir = sobel_v3(i_x, i_y, value);
+	}
+	return dir;
+}
+
+inline direction sobel_px(linebuffer2& buffer, windowbuffer3& window, uint8_t& value, uint16_t x, uint16_t y,
+		uint32_t mask, uint16_t width, uint16_t height){
+
+	if(x>1 && y>1)
+		update3(buffer, window, value, x);
+
+	return sobel_window_px(window, value, x, y, mask, width, height);
+}
+
+// Fused greyscale, gauss and sobel. The Gaussian rows and the two blurred
+// rows of the gradient are one column word of the same line buffer.
+inline direction front_px(frontbuffer& buffer, gauss_window& gauss_win, windowbuffer3& sobel_win, uint32_t data,
+		uint8_t& value, uint16_t x, uint16_t y, uint32_t mask, uint16_t width, uint16_t height){
+
+	uint8_t column[FRONT_ROWS], tmp[GAUSS_ROWS+1], tmp3[3];
+	for (uint8_t i = 0; i < FRONT_ROWS; i++)
+		column[i] = buffer[i][x];
+
+	value = greyscale_px(data);
+	shift_column<GAUSS_ROWS>(column, value, tmp);
+	value = gauss_window_px(gauss_win, tmp, value, x, y, width, height);
+
+	if(x>1 && y>1){
+		shift_column<2>(column + GAUSS_ROWS, value, tmp3);
+		for (uint8_t i= 0; i < 3; i++)
+			for (uint8_t j = 0; j < 2; j++)
+				sobel_win[i][j] = sobel_win[i][j + 1];
+		for (uint8_t i = 0; i < 3; i++)
+			sobel_win[i][2] = tmp3[i];
 	}
 
-	write_pixel(dst, p, x, y);
+	for (uint8_t i = 0; i < FRONT_ROWS; i++)
+		buffer[i][x] = column[i];
 
-	return angle;
+	return sobel_window_px(sobel_win, value, x, y, mask, width, height);
 }
 
-void suppression(pixel_stream &src, pixel_stream &dst, int16_t& p_angle){
-#pragma HLS INTERFACE ap_ctrl_none port=return
-#pragma HLS INTERFACE ap_none port=&p_angle
-#pragma HLS INTERFACE axis port=&src
-#pragma HLS INTERFACE axis port=&dst
-#pragma HLS PIPELINE II=1
-#pragma HLS inline region recursive
+// Automatic thresholds. The sobel stage counts the magnitudes of the frame
+// in flight while the histogram of the previous frame is scanned, a bin
+// per lane and call after start of frame, and cleared for the next swap.
+// So the scan completes after 256 pixels for any number of lanes, and only
+// a complete scan updates the thresholds.
+
+template<int N>
+inline void hist_start(magnitude_hist<N>& h){
+	h.bank = !h.bank;
+	h.count[h.bank] = 0;
+	h.sum[h.bank] = 0;
+	h.bin = 0;
+	h.w0 = 0;
+	h.s0 = 0;
+	h.best = 0;
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		h.fwd_bin[k] = 256;
+	}
+}
 
-	static uint16_t x = 0;
-	static uint16_t y = 0;
-	static linebuffer2 buffer;
-	static windowbuffer3 window;
-	static linebuffer angle_buff;
-	pixel_data p;
+template<int N>
+inline void hist_count(magnitude_hist<N>& h, int k, uint8_t value){
+	// forward the previous increment, its bin is not written back yet
+	uint32_t c = (h.fwd_bin[k] == value) ? h.fwd_count[k] : h.bins[h.bank][k][value];
+	h.bins[h.bank][k][value] = c + 1;
+	h.fwd_bin[k] = value;
+	h.fwd_count[k] = c + 1;
+	h.count[h.bank]++;
+	h.sum[h.bank] += value;
+}
+
+template<int N>
+inline void hist_scan(magnitude_hist<N>& h){
+	if(h.bin > 255)
+		return;
+
+	data_bool s = !h.bank;
+	uint32_t n = h.count[s];
+	for (int j = 0; j < N; j++){
+#pragma HLS UNROLL
+		uint8_t t = h.bin + j;
+		uint32_t c = 0;
+		for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+			c += h.bins[s][k][t];
+			h.bins[s][k][t] = 0;
+		}
+
+		// percentiles, last bin where the count below it misses the target
+		uint64_t below = (uint64_t) h.w0 * 256;
+		if(below < (uint64_t) n * HIGH_PCT)
+			h.p_high = t;
+		if(below < (uint64_t) n * LOW_PCT)
+			h.p_low = t;
+
+		// Otsu, maximum between-class variance w0*w1*(m0-m1)^2
+		h.w0 += c;
+		h.s0 += t * c;
+		uint32_t w1 = n - h.w0;
+		if(h.w0 && w1){
+			float d = (float) ((int64_t) h.s0 * n - (int64_t) h.sum[s] * h.w0);
+			float var = d * d / ((float) h.w0 * (float) w1);
+			if(var > h.best){
+				h.best = var;
+				h.otsu = t;
+			}
+		}
+
+		if(t == 255 && n){
+			h.high = h.p_high;
+			h.low = h.p_low;
+			h.otsu_high = h.otsu;
+			h.valid = 1;
+		}
+	}
+	h.bin += N;
+}
+
+template<int N>
+inline void select_thresholds(magnitude_hist<N>& h, uint32_t mask, uint8_t mode, uint8_t high_set, uint8_t low_set,
+		uint8_t& high, uint8_t& low, uint16_t& thresholds){
+
+	// the histogram is on the scale of the magnitude already
+	uint8_t hi = scale_threshold(HIGH, mask), lo = scale_threshold(LOW, mask);
+	if(mode == THRES_PERCENTILE && h.valid){
+		hi = h.high;
+		lo = h.low;
+	}else if(mode == THRES_OTSU && h.valid){
+		hi = h.otsu_high;
+		lo = h.otsu_high >> 1;
+	}
 
-	read_pixel(src, p, x, y);
+	// nonzero override registers take precedence
+	high = high_set ? scale_threshold(high_set, mask) : hi;
+	low = low_set ? scale_threshold(low_set, mask) : lo;
+	thresholds = (low << 8) | high;
+}
 
-#pragma HLS ARRAY_PARTITION variable=buffer complete dim=1
-#pragma HLS ARRAY_PARTITION variable=angle_buff complete dim=1
-#pragma HLS ARRAY_PARTITION variable=window complete dim=0
-#pragma HLS dependence variable=buffer inter false
+inline uint8_t suppression_px(linebuffer2& buffer, windowbuffer3& window, dirbuffer& dir_buff,
+		uint8_t value, direction dir, uint16_t x, uint16_t y, uint16_t width, uint16_t height){
 
 	if(x>2 && y>2){
-		update3(buffer, window, p, x);
-		update_angle(p_angle, angle_buff, x);
+		update3(buffer, window, value, x);
+		update_dir(dir, dir_buff, x);
 	}
 
 	int16_t cy=y-1, cx=x-1;
 	uint8_t q=255, r=255;
-	int16_t angle = 0;
 
 	if(y>3 && x>3){
-		angle = angle_buff[0][cx];
-		if(angle < 0)
-			angle += 180;
+		direction sector = dir_buff[0][cx];
 
-		if((0 <= angle < 22.5) or (157.5 <= angle <= 180)){
-			if(bound(cy, cx, 0, 1))
+		if(sector == 0){
+			if(bound(cy, cx, 0, 1, width, height))
 				q = window[1][2];
-			if(bound(cy, cx, 0, -1))
+			if(bound(cy, cx, 0, -1, width, height))
 				r = window[1][0];
-		}else if(22.5 <= angle < 67.5){
-			if(bound(cy, cx, 1, -1))
+		}else if(sector == 1){
+			if(bound(cy, cx, 1, -1, width, height))
 				q = window[2][0];
-			if(bound(cy, cx, -1, 1))
+			if(bound(cy, cx, -1, 1, width, height))
 				r = window[0][2];
-		}else if(67.5 <= angle < 112.5){
-			if(bound(cy, cx, 1, 0))
+		}else if(sector == 2){
+			if(bound(cy, cx, 1, 0, width, height))
 				q = window[2][1];
-			if(bound(cy, cx, -1, 0))
+			if(bound(cy, cx, -1, 0, width, height))
 				r = window[0][1];
-		}else if(112.5 <= angle < 157.5){
-			if(bound(cy, cx, -1, -1))
+		}else{
+			if(bound(cy, cx, -1, -1, width, height))
 				q = window[0][0];
-			if(bound(cy, cx, 1, 1))
+			if(bound(cy, cx, 1, 1, width, height))
 				r = window[2][2];
 		}
 
-		uint8_t value = window[1][1];
-		if(value >= q && value >=r )
-			set_pixel(p, value);
+		uint8_t center = window[1][1];
+		if(center >= q && center >=r )
+			return center;
 		else
-			set_pixel(p, 0);
+			return 0;
 	}
-
-	write_pixel(dst, p, x, y);
+	return value;
 }
 
-void threshold(pixel_stream &src, pixel_stream &dst){
-#pragma HLS INTERFACE ap_ctrl_none port=return
-#pragma HLS INTERFACE axis port=&src
-#pragma HLS INTERFACE axis port=&dst
-#pragma HLS PIPELINE II=1
-#pragma HLS inline region recursive
-
-    static uint16_t x = 0;
-    static uint16_t y = 0;
-	pixel_data p;
+// HIGH and LOW of a frame travel in-band from sobel to threshold, as the
+// values of pixels 0 and 1 of row THRES_ROW. Suppression and threshold pass
+// those through and hysteresis clears them.
+inline uint8_t stamp_thresholds(uint8_t value, uint16_t x, uint16_t y, uint8_t high, uint8_t low){
+	if(y == THRES_ROW && x < 2)
+		return x ? low : high;
+	return value;
+}
 
-	read_pixel(src, p, x, y);
+inline void latch_thresholds(uint8_t value, uint16_t x, uint16_t y, uint8_t& hi, uint8_t& lo){
+	if(y == THRES_ROW && x == 0)
+		hi = value;
+	if(y == THRES_ROW && x == 1)
+		lo = value;
+}
 
-    uint8_t data;
+inline uint8_t threshold_px(uint8_t data, uint16_t x, uint16_t y, uint8_t high, uint8_t low){
 
     if(y>3 && x>3){
-    	data = get_value(p);
-		if(data>= HIGH)
-			set_pixel(p, STRONG);
-		else if(data>= LOW)
-			set_pixel(p, WEAK);
+		if(data>= high)
+			return STRONG;
+		else if(data>= low)
+			return WEAK;
 		else
-			set_pixel(p, 0);
+			return 0;
     }
-
-	write_pixel(dst, p, x, y);
+	return data;
 }
 
-void hysteresis(pixel_stream &src, pixel_stream &dst){
-#pragma HLS INTERFACE ap_ctrl_none port=return
-#pragma HLS INTERFACE axis port=&src
-#pragma HLS INTERFACE axis port=&dst
-#pragma HLS PIPELINE II=1
-#pragma HLS inline region recursive
-
-	static uint16_t x = 0;
-    static uint16_t y = 0;
-	static linebuffer2 buffer;
-	static windowbuffer3 window;
-	pixel_data p;
-
-	read_pixel(src, p, x, y);
-
-#pragma HLS ARRAY_PARTITION variable=buffer complete dim=1
-#pragma HLS ARRAY_PARTITION variable=window complete dim=0
-#pragma HLS dependence variable=buffer inter false
+inline uint8_t hysteresis_px(linebuffer2& buffer, windowbuffer3& window, uint8_t value, uint16_t x, uint16_t y,
+		uint16_t width, uint16_t height){
 
 	if(x>3 && y>3)
-		update3(buffer, window, p, x);
+		update3(buffer, window, value, x);
 
-	uint8_t data;
+	uint8_t data = 0;
 	data_bool flag;
 	int16_t cy=y-1, cx=x-1;
 
@@ -387,7 +640,7 @@ void hysteresis(pixel_stream &src, pixel_stream &dst){
 		if(data == WEAK){
 			for(int8_t i =-1; i < 2; i++){
 				for(int8_t j=-1; j< 2; j++){
-					if(bound(cy,cx,i,j)){
+					if(bound(cy,cx,i,j, width, height)){
 						if(window[i+1][j+1] == STRONG){
 							flag = 1;
 						}
@@ -398,19 +651,1374 @@ void hysteresis(pixel_stream &src, pixel_stream &dst){
 			}
 
 			if(flag){
-				set_pixel(p, STRONG);
 				window[1][1] = STRONG;
+				return STRONG;
 			}else{
-				set_pixel(p, 0);
 				window[1][1] = 0;
+				return 0;
 			}
 		}else
-			set_pixel(p, data);
+			return data;
 
     }else if(y>4 && x>4)
-    	set_pixel(p, data);
+    	return data;
     else
-    	set_pixel(p, 0);
+    	return 0;
+}
+
+// Root of a run slot, fixed depth so the lookup pipelines. Roots are their
+// own parent, so the hops past the root are harmless.
+inline uint16_t find_root(uint16_t parent[HYST_SLOTS], uint16_t a){
+	for(int i = 0; i < HYST_HOPS; i++){
+#pragma HLS unroll
+		a = parent[a];
+	}
+	return a;
+}
+
+// Number of the set two sets make, the younger links to the older
+inline uint16_t join_sets(hyst_state& h, uint16_t a, uint16_t b){
+	if(!a)
+		return b;
+	if(!b || a == b)
+		return a;
+
+	uint16_t older = (a < b) ? a : b;
+	h.link[h.bank][(a == older) ? b : a] = older;
+	return older;
+}
+
+// Join the current run to the set of the run above at slot a
+inline void touch_run(hyst_state& h, data_bool row, uint16_t a){
+	if(!a)
+		return;
+	h.touched = 1;
+
+	uint16_t above = find_root(h.parent[!row], a);
+	uint16_t root = h.run;
+	uint16_t r = h.fwd[!row][above];
+	uint16_t set = h.set[!row][above];
+	data_bool strong = h.strong[!row][above];
+
+	if(!r)
+		h.fwd[!row][above] = root;
+	else{
+		// the set reached this row already, through an earlier run
+		r = find_root(h.parent[row], r);
+		if(r == root)
+			return;
+		set = h.set[row][r];
+		strong = h.strong[row][r];
+	}
+	set = join_sets(h, h.set[row][root], set);
+	strong = strong | h.strong[row][root];
+
+	if(r){
+		if(h.rank[row][r] > h.rank[row][root]){
+			h.parent[row][root] = r;
+			root = r;
+		}else{
+			h.parent[row][r] = root;
+			if(h.rank[row][r] == h.rank[row][root])
+				h.rank[row][root]++;
+		}
+	}
+	h.set[row][root] = set;
+	h.strong[row][root] = strong;
+	if(set)
+		h.verdict[h.bank][set] = strong;
+	h.run = root;
+}
+
+// A run that touched nothing above starts a set
+inline void end_run(hyst_state& h, data_bool row){
+	if(h.touched)
+		return;
+
+	uint16_t set = (h.next <= HYST_SETS) ? h.next++ : 0;
+	if(set){
+		h.link[h.bank][set] = 0;
+		h.verdict[h.bank][set] = h.strong[row][h.run];
+	}
+	h.set[row][h.run] = set;
+}
+
+// Pass 2: verdict of a run of the previous frame, from the run above or
+// from the set it starts. Sets are resolved in the order pass 1 numbered
+// them, so the older set a link points to is final already.
+inline void end_replay(hyst_state& h, data_bool row){
+	data_bool old = !h.bank;
+	data_bool v = h.out_verdict;
+
+	if(!h.out_touched){
+		uint16_t set = (h.out_next <= HYST_SETS) ? h.out_next++ : 0;
+		v = 0;
+		if(set){
+			uint16_t l = h.link[old][set];
+			v = h.verdict[old][l ? l : set];
+			h.verdict[old][set] = v;
+		}
+	}
+	h.run_verdict[row][h.out_slots] = v;
+}
+
+inline void touch_replay(hyst_state& h, data_bool row, uint16_t e){
+	if(e & 3){
+		h.out_touched = 1;
+		h.out_verdict = h.run_verdict[!row][e >> 2];
+	}
+}
+
+inline void hyst_start(hyst_state& h){
+	h.bank = !h.bank;
+	h.next = 1;
+	h.out_next = 1;
+}
+
+inline uint8_t hyst_exact_px(hyst_state& h, uint8_t value, uint16_t x, uint16_t y, uint16_t width, uint16_t height){
+
+	data_bool row = y & 1;
+	if(x == 0){
+		h.slots = 0;
+		h.out_slots = 0;
+		h.up_left = 0;
+		h.out_up_left = 0;
+		h.up = (y > 0) ? h.labels[0] : 0;
+		h.out_up = (y > 0) ? h.replay[0] : 0;
+	}
+	data_bool right = y > 0 && bound(y, x, 0, 1, width, height);
+	uint16_t up_right = right ? h.labels[x+1] : 0;
+	uint16_t out_up_right = right ? h.replay[x+1] : 0;
+
+	// pass 2, pixel (x-1,y-1) of the previous frame goes out with the run
+	// verdicts of its row, the window centre the 3x3 mode outputs
+	uint8_t out = 0;
+	if(x > 0 && y > 0){
+		uint8_t c_out = h.out_up_left & 3;
+		if(c_out == 2 || (c_out == 1 && h.run_verdict[!row][h.out_up_left >> 2]))
+			out = STRONG;
+	}
+
+	uint8_t c_old = (h.classes[y][x>>2] >> (2*(x&3))) & 3;
+	if(c_old){
+		if(x == 0 || !h.out_last){
+			h.out_slots++;
+			h.out_touched = 0;
+			touch_replay(h, row, h.out_up_left);
+			touch_replay(h, row, h.out_up);
+		}
+		touch_replay(h, row, out_up_right);
+		if(x == width-1)
+			end_replay(h, row);
+	}else if(x > 0 && h.out_last)
+		end_replay(h, row);
+	h.out_last = c_old;
+	h.replay[x] = c_old ? (uint16_t)(h.out_slots << 2 | c_old) : 0;
+	h.out_up_left = h.out_up;
+	h.out_up = out_up_right;
+
+	// pass 1, label pixel (x,y) of this frame
+	uint8_t c = 0;
+	if(y>3 && x>3)
+		c = (value == STRONG) ? 2 : (value == WEAK) ? 1 : 0;
+	h.classes[y][x>>2] = (h.classes[y][x>>2] & ~(3 << (2*(x&3)))) | (c << (2*(x&3)));
+
+	if(c){
+		if(x == 0 || !h.last){
+			h.slot = ++h.slots;
+			h.parent[row][h.slot] = h.slot;
+			h.rank[row][h.slot] = 0;
+			h.fwd[row][h.slot] = 0;
+			h.set[row][h.slot] = 0;
+			h.strong[row][h.slot] = 0;
+			h.run = h.slot;
+			h.touched = 0;
+			touch_run(h, row, h.up_left);
+			touch_run(h, row, h.up);
+		}
+		touch_run(h, row, up_right);
+		if(c == 2){
+			h.strong[row][h.run] = 1;
+			if(h.set[row][h.run])
+				h.verdict[h.bank][h.set[row][h.run]] = 1;
+		}
+		if(x == width-1)
+			end_run(h, row);
+	}else if(x > 0 && h.last)
+		end_run(h, row);
+	h.last = c;
+	h.labels[x] = c ? h.slot : 0;
+	h.up_left = h.up;
+	h.up = up_right;
+
+	return out;
+}
+
+// Multi-camera stages: K streams share one stage, each with its own bank
+// of coordinates, counters and line buffers, picked per beat by TDEST.
+// Stalls count on bank 0, the stage cannot tell whose beat is missing.
+// K = 1 is the single-stream stage.
+
+template<int K, typename TI, typename TO>
+data_bool greyscale_banks(greyscale_state s[K], hls::stream<TI> &src, hls::stream<TO> &dst, perf_counters perf[K]){
+#pragma HLS inline
+
+	TI p;
+
+	if(stalled(src, dst, s[0].counters)){
+		perf[0] = s[0].counters;
+		return 0;
+	}
+	src >> p;
+	greyscale_state& b = s[bank<K>(p)];
+	count_pixel(p, b.x, b.y, b.counters);
+
+	uint8_t intensity = greyscale_px(p.data);
+
+	TO q;
+	convert(p, q);
+	set_pixel(q, intensity);
+
+	write_pixel(dst, q, b.x, b.y);
+	perf[bank<K>(p)] = b.counters;
+	return 1;
+}
+
+template<typename TO>
+data_bool greyscale_stage(greyscale_state& s, pixel_stream &src, hls::stream<TO> &dst, perf_counters& perf){
+#pragma HLS inline
+
+	return greyscale_banks<1>(&s, src, dst, &perf);
+}
+
+template<int K, typename T>
+data_bool gauss_banks(gauss_state s[K], hls::stream<T> &src, hls::stream<T> &dst, uint16_t width, uint16_t height, perf_counters perf[K]){
+#pragma HLS inline
+
+	T p;
+
+	if(stalled(src, dst, s[0].counters)){
+		perf[0] = s[0].counters;
+		return 0;
+	}
+	src >> p;
+	gauss_state& b = s[bank<K>(p)];
+	count_pixel(p, b.x, b.y, b.counters);
+
+#pragma HLS ARRAY_PARTITION variable=b.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=b.window complete dim=0
+#pragma HLS dependence variable=b.buffer inter false
+
+	set_pixel(p, gauss_px(b.buffer, b.window, get_value(p), b.x, b.y, width, height));
+
+	write_pixel(dst, p, b.x, b.y);
+	perf[bank<K>(p)] = b.counters;
+	return 1;
+}
+
+template<typename T>
+data_bool gauss_stage(gauss_state& s, hls::stream<T> &src, hls::stream<T> &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	return gauss_banks<1>(&s, src, dst, width, height, &perf);
+}
+
+// HIGH and LOW follow the histogram of the bank of the beat, thresholds
+// keeps the register of every bank
+template<int K, typename T>
+data_bool sobel_banks(sobel_state<1> s[K], hls::stream<T> &src, hls::stream<T> &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t thresholds[K], perf_counters perf[K]){
+#pragma HLS inline
+
+	T p;
+
+	if(stalled(src, dst, s[0].counters)){
+		perf[0] = s[0].counters;
+		return 0;
+	}
+	src >> p;
+	sobel_state<1>& b = s[bank<K>(p)];
+	count_pixel(p, b.x, b.y, b.counters);
+
+#pragma HLS ARRAY_PARTITION variable=b.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=b.window complete dim=0
+#pragma HLS ARRAY_PARTITION variable=b.hist.bins complete dim=1
+#pragma HLS dependence variable=b.buffer inter false
+#pragma HLS dependence variable=b.hist.bins inter false
+
+	if(p.user)
+		hist_start(b.hist);
+
+	uint8_t value = get_value(p);
+	direction dir = sobel_px(b.buffer, b.window, value, b.x, b.y, mask, width, height);
+
+	if(b.y>2 && b.x>2)
+		hist_count(b.hist, 0, value);
+	hist_scan(b.hist);
+	uint8_t high, low;
+	select_thresholds(b.hist, mask, thres_mode, high_set, low_set, high, low, thresholds[bank<K>(p)]);
+	set_pixel(p, stamp_thresholds(value, b.x, b.y, high, low));
+	set_dir(p, dir);
+
+	write_pixel(dst, p, b.x, b.y);
+	perf[bank<K>(p)] = b.counters;
+	return 1;
+}
+
+template<typename T>
+data_bool sobel_stage(sobel_state<1>& s, hls::stream<T> &src, hls::stream<T> &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS inline
+
+	return sobel_banks<1>(&s, src, dst, mask, width, height, thres_mode, high_set, low_set, &thresholds, &perf);
+}
+
+template<typename TO>
+data_bool front_stage(front_state& s, pixel_stream &src, hls::stream<TO> &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS inline
+
+	pixel_data p;
+
+	if(stalled(src, dst, s.counters)){
+		perf = s.counters;
+		return 0;
+	}
+	read_pixel(src, p, s.x, s.y, s.counters);
+
+#pragma HLS ARRAY_RESHAPE variable=s.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=s.gauss_win complete dim=0
+#pragma HLS ARRAY_PARTITION variable=s.sobel_win complete dim=0
+#pragma HLS ARRAY_PARTITION variable=s.hist.bins complete dim=1
+#pragma HLS dependence variable=s.buffer inter false
+#pragma HLS dependence variable=s.hist.bins inter false
+
+	if(p.user)
+		hist_start(s.hist);
+
+	uint8_t value;
+	direction dir = front_px(s.buffer, s.gauss_win, s.sobel_win, p.data, value, s.x, s.y, mask, width, height);
+
+	if(s.y>2 && s.x>2)
+		hist_count(s.hist, 0, value);
+	hist_scan(s.hist);
+	uint8_t high, low;
+	select_thresholds(s.hist, mask, thres_mode, high_set, low_set, high, low, thresholds);
+
+	TO q;
+	convert(p, q);
+	set_pixel(q, stamp_thresholds(value, s.x, s.y, high, low));
+	set_dir(q, dir);
+
+	write_pixel(dst, q, s.x, s.y);
+	perf = s.counters;
+	return 1;
+}
+
+template<int K, typename T>
+data_bool suppression_banks(suppression_state s[K], hls::stream<T> &src, hls::stream<T> &dst, uint16_t width, uint16_t height, perf_counters perf[K]){
+#pragma HLS inline
+
+	T p;
+
+	if(stalled(src, dst, s[0].counters)){
+		perf[0] = s[0].counters;
+		return 0;
+	}
+	src >> p;
+	suppression_state& b = s[bank<K>(p)];
+	count_pixel(p, b.x, b.y, b.counters);
+
+#pragma HLS ARRAY_PARTITION variable=b.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=b.dir_buff complete dim=1
+#pragma HLS ARRAY_PARTITION variable=b.window complete dim=0
+#pragma HLS dependence variable=b.buffer inter false
+
+	set_pixel(p, suppression_px(b.buffer, b.window, b.dir_buff, get_value(p), get_dir(p), b.x, b.y, width, height));
+	clear_dir(p);
+
+	write_pixel(dst, p, b.x, b.y);
+	perf[bank<K>(p)] = b.counters;
+	return 1;
+}
+
+template<typename T>
+data_bool suppression_stage(suppression_state& s, hls::stream<T> &src, hls::stream<T> &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	return suppression_banks<1>(&s, src, dst, width, height, &perf);
+}
+
+template<int K, typename T>
+data_bool threshold_banks(threshold_state s[K], hls::stream<T> &src, hls::stream<T> &dst, perf_counters perf[K]){
+#pragma HLS inline
+
+	T p;
+
+	if(stalled(src, dst, s[0].counters)){
+		perf[0] = s[0].counters;
+		return 0;
+	}
+	src >> p;
+	threshold_state& b = s[bank<K>(p)];
+	count_pixel(p, b.x, b.y, b.counters);
+
+	// take over the thresholds of this frame before the first pixel they apply to
+	latch_thresholds(get_value(p), b.x, b.y, b.hi, b.lo);
+	set_pixel(p, threshold_px(get_value(p), b.x, b.y, b.hi, b.lo));
+
+	write_pixel(dst, p, b.x, b.y);
+	perf[bank<K>(p)] = b.counters;
+	return 1;
+}
+
+template<typename T>
+data_bool threshold_stage(threshold_state& s, hls::stream<T> &src, hls::stream<T> &dst, perf_counters& perf){
+#pragma HLS inline
+
+	return threshold_banks<1>(&s, src, dst, &perf);
+}
+
+// Hysteresis of a pixel, only the state with the exact tables has hyst_mode,
+// the window state leaves start of frame and hyst_mode unnamed
+inline uint8_t hysteresis_value(hysteresis_window_state& b, uint8_t value, data_bool, uint16_t width, uint16_t height,
+		uint8_t){
+	return hysteresis_px(b.buffer, b.window, value, b.x, b.y, width, height);
+}
+
+#if HYST_EXACT_ENABLE
+inline uint8_t hysteresis_value(hysteresis_state& b, uint8_t value, data_bool sof, uint16_t width, uint16_t height,
+		uint8_t hyst_mode){
+#pragma HLS dependence variable=b.hyst.classes inter false
+#pragma HLS dependence variable=b.hyst.labels inter false
+#pragma HLS dependence variable=b.hyst.replay inter false
+
+	if(hyst_mode == HYST_EXACT){
+		if(sof)
+			hyst_start(b.hyst);
+		return hyst_exact_px(b.hyst, value, b.x, b.y, width, height);
+	}
+	return hysteresis_px(b.buffer, b.window, value, b.x, b.y, width, height);
+}
+#endif
+
+template<int K, typename S, typename TI, typename TO>
+data_bool hysteresis_banks(S s[K], hls::stream<TI> &src, hls::stream<TO> &dst, uint16_t width, uint16_t height, uint8_t hyst_mode, perf_counters perf[K]){
+#pragma HLS inline
+
+	TI p;
+
+	if(stalled(src, dst, s[0].counters)){
+		perf[0] = s[0].counters;
+		return 0;
+	}
+	src >> p;
+	S& b = s[bank<K>(p)];
+	count_pixel(p, b.x, b.y, b.counters);
+
+#pragma HLS ARRAY_PARTITION variable=b.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=b.window complete dim=0
+#pragma HLS dependence variable=b.buffer inter false
+
+	set_pixel(p, hysteresis_value(b, get_value(p), p.user, width, height, hyst_mode));
+
+	TO q;
+	convert(p, q);
+	write_pixel(dst, q, b.x, b.y);
+	perf[bank<K>(p)] = b.counters;
+	return 1;
+}
+
+template<typename TI, typename TO>
+data_bool hysteresis_stage(hysteresis_state& s, hls::stream<TI> &src, hls::stream<TO> &dst, uint16_t width, uint16_t height, uint8_t hyst_mode, perf_counters& perf){
+#pragma HLS inline
+
+	return hysteresis_banks<1>(&s, src, dst, width, height, hyst_mode, &perf);
+}
+
+// N pixels per clock: every beat carries N pixels of one line in its
+// lanes, lane k being column x+k. The lanes run the per-pixel kernel in
+// order on the shared line buffers and window, which unrolls into N
+// kernel instances and an N column wide window shift per beat.
+
+template<int B, typename T>
+inline uint32_t get_lane(T& p, int k){
+	return p.data.range(B*k+B-1, B*k);
+}
+
+template<int B, typename T>
+inline void set_lane(T& p, int k, uint32_t value){
+	p.data.range(B*k+B-1, B*k) = value;
+}
+
+template<typename T>
+inline direction get_lane_dir(T& p, int k){
+	return p.user.range(2*k+2, 2*k+1);
+}
+
+template<typename T>
+inline void set_lane_dir(T& p, int k, direction d){
+	p.user.range(2*k+2, 2*k+1) = d;
+}
+
+template<typename TI, typename TO>
+inline void convert_beat(TI& p, TO& q){
+	q.keep = -1;
+	q.strb = -1;
+	q.user = p.user;
+	q.last = p.last;
+	q.id = p.id;
+	q.dest = p.dest;
+}
+
+template<int N>
+data_bool greyscale_ppc(greyscale_state& s, typename ppc_types<N>::rgba_stream &src, typename ppc_types<N>::grey_stream &dst, perf_counters& perf){
+#pragma HLS inline
+
+	typename ppc_types<N>::rgba_beat p;
+	typename ppc_types<N>::grey_beat q;
+
+	if(stalled(src, dst, s.counters)){
+		perf = s.counters;
+		return 0;
+	}
+	read_pixel(src, p, s.x, s.y, s.counters, N);
+	convert_beat(p, q);
+
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		set_lane<8>(q, k, greyscale_px(get_lane<32>(p, k)));
+	}
+
+	write_pixel(dst, q, s.x, s.y, N);
+	perf = s.counters;
+	return 1;
+}
+
+template<int N>
+data_bool greyscale_ppc(typename ppc_types<N>::rgba_stream &src, typename ppc_types<N>::grey_stream &dst, perf_counters& perf){
+#pragma HLS inline
+
+	static greyscale_state s;
+	return greyscale_ppc<N>(s, src, dst, perf);
+}
+
+template<int N>
+data_bool gauss_ppc(gauss_state& s, typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	typename ppc_types<N>::grey_beat p;
+
+	if(stalled(src, dst, s.counters)){
+		perf = s.counters;
+		return 0;
+	}
+	read_pixel(src, p, s.x, s.y, s.counters, N);
+
+#pragma HLS ARRAY_PARTITION variable=s.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=s.buffer cyclic factor=N dim=2
+#pragma HLS ARRAY_PARTITION variable=s.window complete dim=0
+#pragma HLS dependence variable=s.buffer inter false
+
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		set_lane<8>(p, k, gauss_px(s.buffer, s.window, get_lane<8>(p, k), s.x+k, s.y, width, height));
+	}
+
+	write_pixel(dst, p, s.x, s.y, N);
+	perf = s.counters;
+	return 1;
+}
+
+template<int N>
+data_bool gauss_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	static gauss_state s;
+	return gauss_ppc<N>(s, src, dst, width, height, perf);
+}
+
+template<int N>
+data_bool sobel_ppc(sobel_state<N>& s, typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint32_t mask, uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS inline
+
+	typename ppc_types<N>::grey_beat p;
+
+	if(stalled(src, dst, s.counters)){
+		perf = s.counters;
+		return 0;
+	}
+	read_pixel(src, p, s.x, s.y, s.counters, N);
+
+#pragma HLS ARRAY_PARTITION variable=s.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=s.buffer cyclic factor=N dim=2
+#pragma HLS ARRAY_PARTITION variable=s.window complete dim=0
+#pragma HLS ARRAY_PARTITION variable=s.hist.bins complete dim=1
+#pragma HLS ARRAY_PARTITION variable=s.hist.bins complete dim=2
+#pragma HLS ARRAY_PARTITION variable=s.hist.bins cyclic factor=N dim=3
+#pragma HLS dependence variable=s.buffer inter false
+#pragma HLS dependence variable=s.hist.bins inter false
+
+	if(p.user)
+		hist_start(s.hist);
+
+	uint8_t values[N];
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		values[k] = get_lane<8>(p, k);
+		set_lane_dir(p, k, sobel_px(s.buffer, s.window, values[k], s.x+k, s.y, mask, width, height));
+
+		if(s.y>2 && s.x+k>2)
+			hist_count(s.hist, k, values[k]);
+	}
+	hist_scan(s.hist);
+	uint8_t high, low;
+	select_thresholds(s.hist, mask, thres_mode, high_set, low_set, high, low, thresholds);
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		set_lane<8>(p, k, stamp_thresholds(values[k], s.x+k, s.y, high, low));
+	}
+
+	write_pixel(dst, p, s.x, s.y, N);
+	perf = s.counters;
+	return 1;
+}
+
+template<int N>
+data_bool sobel_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint32_t mask, uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS inline
+
+	static sobel_state<N> s;
+	return sobel_ppc<N>(s, src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+template<int N>
+data_bool suppression_ppc(suppression_state& s, typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	typename ppc_types<N>::grey_beat p;
+
+	if(stalled(src, dst, s.counters)){
+		perf = s.counters;
+		return 0;
+	}
+	read_pixel(src, p, s.x, s.y, s.counters, N);
+
+#pragma HLS ARRAY_PARTITION variable=s.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=s.buffer cyclic factor=N dim=2
+#pragma HLS ARRAY_PARTITION variable=s.dir_buff complete dim=1
+#pragma HLS ARRAY_PARTITION variable=s.dir_buff cyclic factor=N dim=2
+#pragma HLS ARRAY_PARTITION variable=s.window complete dim=0
+#pragma HLS dependence variable=s.buffer inter false
+
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		set_lane<8>(p, k, suppression_px(s.buffer, s.window, s.dir_buff, get_lane<8>(p, k), get_lane_dir(p, k), s.x+k, s.y, width, height));
+	}
+	p.user = p.user & 1;
+
+	write_pixel(dst, p, s.x, s.y, N);
+	perf = s.counters;
+	return 1;
+}
+
+template<int N>
+data_bool suppression_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	static suppression_state s;
+	return suppression_ppc<N>(s, src, dst, width, height, perf);
+}
+
+template<int N>
+data_bool threshold_ppc(threshold_state& s, typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		perf_counters& perf){
+#pragma HLS inline
+
+	typename ppc_types<N>::grey_beat p;
+
+	if(stalled(src, dst, s.counters)){
+		perf = s.counters;
+		return 0;
+	}
+	read_pixel(src, p, s.x, s.y, s.counters, N);
+
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		latch_thresholds(get_lane<8>(p, k), s.x+k, s.y, s.hi, s.lo);
+		set_lane<8>(p, k, threshold_px(get_lane<8>(p, k), s.x+k, s.y, s.hi, s.lo));
+	}
+
+	write_pixel(dst, p, s.x, s.y, N);
+	perf = s.counters;
+	return 1;
+}
+
+template<int N>
+data_bool threshold_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		perf_counters& perf){
+#pragma HLS inline
+
+	static threshold_state s = THRESHOLD_STATE_INIT;
+	return threshold_ppc<N>(s, src, dst, perf);
+}
+
+template<int N>
+data_bool hysteresis_ppc(hysteresis_window_state& s, typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::rgba_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	typename ppc_types<N>::grey_beat p;
+	typename ppc_types<N>::rgba_beat q;
+
+	if(stalled(src, dst, s.counters)){
+		perf = s.counters;
+		return 0;
+	}
+	read_pixel(src, p, s.x, s.y, s.counters, N);
+	convert_beat(p, q);
+
+#pragma HLS ARRAY_PARTITION variable=s.buffer complete dim=1
+#pragma HLS ARRAY_PARTITION variable=s.buffer cyclic factor=N dim=2
+#pragma HLS ARRAY_PARTITION variable=s.window complete dim=0
+#pragma HLS dependence variable=s.buffer inter false
+
+	for (int k = 0; k < N; k++){
+#pragma HLS UNROLL
+		uint32_t value = hysteresis_px(s.buffer, s.window, get_lane<8>(p, k), s.x+k, s.y, width, height);
+		set_lane<32>(q, k, 0xFF000000 | (value << 16) | (value << 8) | value);
+	}
+
+	write_pixel(dst, q, s.x, s.y, N);
+	perf = s.counters;
+	return 1;
+}
+
+template<int N>
+data_bool hysteresis_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::rgba_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS inline
+
+	static hysteresis_window_state s;
+	return hysteresis_ppc<N>(s, src, dst, width, height, perf);
+}
+
+// Instances for the C-simulation testbench
+#define PPC_INSTANCE(N) \
+	template data_bool greyscale_ppc<N>(ppc_types<N>::rgba_stream&, ppc_types<N>::grey_stream&, perf_counters&); \
+	template data_bool gauss_ppc<N>(ppc_types<N>::grey_stream&, ppc_types<N>::grey_stream&, uint16_t, uint16_t, perf_counters&); \
+	template data_bool sobel_ppc<N>(ppc_types<N>::grey_stream&, ppc_types<N>::grey_stream&, uint32_t, uint16_t, uint16_t, \
+		uint8_t, uint8_t, uint8_t, uint16_t&, perf_counters&); \
+	template data_bool suppression_ppc<N>(ppc_types<N>::grey_stream&, ppc_types<N>::grey_stream&, uint16_t, uint16_t, perf_counters&); \
+	template data_bool threshold_ppc<N>(ppc_types<N>::grey_stream&, ppc_types<N>::grey_stream&, perf_counters&); \
+	template data_bool hysteresis_ppc<N>(ppc_types<N>::grey_stream&, ppc_types<N>::rgba_stream&, uint16_t, uint16_t, perf_counters&);
+
+PPC_INSTANCE(1)
+PPC_INSTANCE(2)
+PPC_INSTANCE(4)
+
+// Instances for the host pipelines, per stream format between the stages
+#define STAGE_INSTANCE(T) \
+	template data_bool greyscale_stage<T>(greyscale_state&, pixel_stream&, hls::stream<T>&, perf_counters&); \
+	template data_bool gauss_stage<T>(gauss_state&, hls::stream<T>&, hls::stream<T>&, uint16_t, uint16_t, perf_counters&); \
+	template data_bool sobel_stage<T>(sobel_state<1>&, hls::stream<T>&, hls::stream<T>&, uint32_t, uint16_t, uint16_t, \
+		uint8_t, uint8_t, uint8_t, uint16_t&, perf_counters&); \
+	template data_bool front_stage<T>(front_state&, pixel_stream&, hls::stream<T>&, uint32_t, uint16_t, uint16_t, \
+		uint8_t, uint8_t, uint8_t, uint16_t&, perf_counters&); \
+	template data_bool suppression_stage<T>(suppression_state&, hls::stream<T>&, hls::stream<T>&, uint16_t, uint16_t, perf_counters&); \
+	template data_bool threshold_stage<T>(threshold_state&, hls::stream<T>&, hls::stream<T>&, perf_counters&); \
+	template data_bool hysteresis_stage<T, pixel_data>(hysteresis_state&, hls::stream<T>&, pixel_stream&, uint16_t, uint16_t, \
+		uint8_t, perf_counters&);
+
+STAGE_INSTANCE(pixel_data)
+STAGE_INSTANCE(grey_data)
+
+// 32-bit RGBA stream between all stages
+
+void greyscale(pixel_stream &src, pixel_stream &dst, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static greyscale_state s;
+	greyscale_stage(s, src, dst, perf);
+}
+
+void gauss(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static gauss_state s;
+	gauss_stage(s, src, dst, width, height, perf);
+}
+
+void sobel(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static sobel_state<1> s;
+	sobel_stage(s, src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+void suppression(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static suppression_state s;
+	suppression_stage(s, src, dst, width, height, perf);
+}
+
+void threshold(pixel_stream &src, pixel_stream &dst, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static threshold_state s = THRESHOLD_STATE_INIT;
+	threshold_stage(s, src, dst, perf);
+}
+
+void hysteresis(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static hysteresis_window_state s;
+	hysteresis_banks<1>(&s, src, dst, width, height, HYST_WINDOW, &perf);
+}
+
+#if HYST_EXACT_ENABLE
+void hysteresis_exact(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static hysteresis_state s;
+	hysteresis_stage(s, src, dst, width, height, HYST_EXACT, perf);
+}
+#endif
+
+// 8-bit grey stream after greyscale, RGBA is rebuilt by hysteresis8
+
+void greyscale8(pixel_stream &src, grey_stream &dst, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static greyscale_state s;
+	greyscale_stage(s, src, dst, perf);
+}
+
+void gauss8(grey_stream &src, grey_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static gauss_state s;
+	gauss_stage(s, src, dst, width, height, perf);
+}
+
+void sobel8(grey_stream &src, grey_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static sobel_state<1> s;
+	sobel_stage(s, src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+void suppression8(grey_stream &src, grey_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static suppression_state s;
+	suppression_stage(s, src, dst, width, height, perf);
+}
+
+void threshold8(grey_stream &src, grey_stream &dst, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static threshold_state s = THRESHOLD_STATE_INIT;
+	threshold_stage(s, src, dst, perf);
+}
+
+void hysteresis8(grey_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static hysteresis_window_state s;
+	hysteresis_banks<1>(&s, src, dst, width, height, HYST_WINDOW, &perf);
+}
+
+#if HYST_EXACT_ENABLE
+void hysteresis_exact8(grey_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static hysteresis_state s;
+	hysteresis_stage(s, src, dst, width, height, HYST_EXACT, perf);
+}
+#endif
+
+// Fused greyscale, gauss and sobel front end, drop-in for the first three
+// stages of either stream format
+
+void front(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static front_state s;
+	front_stage(s, src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+void front8(pixel_stream &src, grey_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	static front_state s;
+	front_stage(s, src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+// PPC pixels per clock, wide AXI4-Stream beats between all stages
+
+void greyscale_wide(rgba_beat_stream &src, grey_beat_stream &dst, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	greyscale_ppc<PPC>(src, dst, perf);
+}
+
+void gauss_wide(grey_beat_stream &src, grey_beat_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	gauss_ppc<PPC>(src, dst, width, height, perf);
+}
+
+void sobel_wide(grey_beat_stream &src, grey_beat_stream &dst, uint32_t mask,
+		uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set,
+		uint16_t& thresholds, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	sobel_ppc<PPC>(src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+void suppression_wide(grey_beat_stream &src, grey_beat_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	suppression_ppc<PPC>(src, dst, width, height, perf);
+}
+
+void threshold_wide(grey_beat_stream &src, grey_beat_stream &dst, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	threshold_ppc<PPC>(src, dst, perf);
+}
+
+void hysteresis_wide(grey_beat_stream &src, rgba_beat_stream &dst, uint16_t width, uint16_t height, perf_counters& perf){
+#pragma HLS INTERFACE ap_ctrl_none port=return
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=perf
+#pragma HLS PIPELINE II=1
+#pragma HLS inline region recursive
+
+	hysteresis_ppc<PPC>(src, dst, width, height, perf);
+}
+
+// Whole chain as one IP. Every stage is a dataflow process taking the
+// given number of beats per start, connected by 8-bit grey streams. HIGH
+// and LOW travel in-band as between the separate IPs. With K > 1 every
+// process holds K banks and the beats of up to K cameras share the chain,
+// each camera then carries the thresholds of its own histogram.
+
+template<int K, typename TP, typename TG>
+static void greyscale_process(hls::stream<TP> &src, hls::stream<TG> &dst, uint64_t beats){
+	static greyscale_state s[K];
+	perf_counters perf[K] = {};
+	for (uint64_t n = 0; n < beats; ){
+#pragma HLS PIPELINE II=1
+		n += greyscale_banks<K>(s, src, dst, perf);
+	}
+}
+
+template<int K, typename TG>
+static void gauss_process(hls::stream<TG> &src, hls::stream<TG> &dst, uint64_t beats, uint16_t width, uint16_t height){
+	static gauss_state s[K];
+	perf_counters perf[K] = {};
+	for (uint64_t n = 0; n < beats; ){
+#pragma HLS PIPELINE II=1
+		n += gauss_banks<K>(s, src, dst, width, height, perf);
+	}
+}
+
+template<int K, typename TG>
+static void sobel_process(hls::stream<TG> &src, hls::stream<TG> &dst, uint64_t beats, uint32_t mask,
+		uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t thresholds[K]){
+	static sobel_state<1> s[K];
+	perf_counters perf[K] = {};
+	for (uint64_t n = 0; n < beats; ){
+#pragma HLS PIPELINE II=1
+		n += sobel_banks<K>(s, src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+	}
+}
+
+template<int K, typename TG>
+static void suppression_process(hls::stream<TG> &src, hls::stream<TG> &dst, uint64_t beats, uint16_t width, uint16_t height){
+	static suppression_state s[K];
+	perf_counters perf[K] = {};
+	for (uint64_t n = 0; n < beats; ){
+#pragma HLS PIPELINE II=1
+		n += suppression_banks<K>(s, src, dst, width, height, perf);
+	}
+}
+
+// HIGH and LOW are latched in row THRES_ROW before the first pixel they
+// apply to, so the banks need no initial thresholds
+template<int K, typename TG>
+static void threshold_process(hls::stream<TG> &src, hls::stream<TG> &dst, uint64_t beats){
+	static threshold_state s[K];
+	perf_counters perf[K] = {};
+	for (uint64_t n = 0; n < beats; ){
+#pragma HLS PIPELINE II=1
+		n += threshold_banks<K>(s, src, dst, perf);
+	}
+}
+
+template<int K, typename TG, typename TP>
+static void hysteresis_process(hls::stream<TG> &src, hls::stream<TP> &dst, uint64_t beats, uint16_t width, uint16_t height,
+		uint8_t hyst_mode){
+	static hysteresis_state s[K];
+	perf_counters perf[K] = {};
+	for (uint64_t n = 0; n < beats; ){
+#pragma HLS PIPELINE II=1
+		n += hysteresis_banks<K>(s, src, dst, width, height, hyst_mode, perf);
+	}
+}
+
+template<int K, typename TP, typename TG>
+static void canny_chain(hls::stream<TP> &src, hls::stream<TP> &dst, uint64_t beats, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode, uint16_t thresholds[K]){
+#pragma HLS DATAFLOW
+
+	hls::stream<TG> grey, blur, conv, suppress, thres;
+#pragma HLS STREAM variable=grey depth=CHAIN_DEPTH
+#pragma HLS STREAM variable=blur depth=CHAIN_DEPTH
+#pragma HLS STREAM variable=conv depth=CHAIN_DEPTH
+#pragma HLS STREAM variable=suppress depth=CHAIN_DEPTH
+#pragma HLS STREAM variable=thres depth=CHAIN_DEPTH
+
+	greyscale_process<K>(src, grey, beats);
+	gauss_process<K>(grey, blur, beats, width, height);
+	sobel_process<K>(blur, conv, beats, mask, width, height, thres_mode, high_set, low_set, thresholds);
+	suppression_process<K>(conv, suppress, beats, width, height);
+	threshold_process<K>(suppress, thres, beats);
+	hysteresis_process<K>(thres, dst, beats, width, height, hyst_mode);
+}
+
+void canny(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode, uint16_t& thresholds){
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=hyst_mode
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=return
+
+	canny_chain<1, pixel_data, grey_data>(src, dst, (uint32_t) width * height, mask, width, height,
+			thres_mode, high_set, low_set, hyst_mode, &thresholds);
+}
+
+// Multi-camera chain, the rows of up to CAMERAS cameras interleaved on one
+// stream with the camera in TDEST. Every camera keeps its own line
+// buffers, histogram and thresholds. A start takes the given number of
+// frames of each of the given number of cameras, counted in 64 bits.
+void canny_cams(cam_pixel_stream &src, cam_pixel_stream &dst, uint16_t frames, uint8_t cameras, uint32_t mask,
+		uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode,
+		uint16_t thresholds[CAMERAS]){
+#pragma HLS INTERFACE axis port=&src
+#pragma HLS INTERFACE axis port=&dst
+#pragma HLS INTERFACE s_axilite port=frames
+#pragma HLS INTERFACE s_axilite port=cameras
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=hyst_mode
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=return
+
+	canny_chain<CAMERAS, cam_pixel_data, cam_grey_data>(src, dst, (uint64_t) frames * cameras * width * height, mask,
+			width, height, thres_mode, high_set, low_set, hyst_mode, thresholds);
+}
+
+// Batch mode, frames are read from DDR and the edge maps written back over
+// m_axi. Both ends walk their buffer sequentially in one II=1 loop, which
+// synthesizes to bursts, and run ahead of or behind the chain by the depth
+// of the streams between the dataflow processes. The pixel count is 64-bit,
+// 65535 frames at 1080p alone exceed 32 bits.
+
+static void read_frames(const ap_uint<32> *in, pixel_stream &dst, uint16_t frames, uint16_t width, uint16_t height){
+	uint64_t pixels = (uint64_t) frames * width * height;
+	uint16_t x = 0, y = 0;
+
+	for (uint64_t i = 0; i < pixels; i++){
+#pragma HLS PIPELINE II=1
+		pixel_data p;
+		p.data = in[i];
+		p.keep = -1;
+		p.strb = -1;
+		p.user = (y == 0 && x == 0);
+		p.last = (x == width - 1);
+		p.id = 0;
+		p.dest = 0;
+		dst << p;
+
+		if (x == width - 1){
+			x = 0;
+			y = (y == height - 1) ? 0 : y + 1;
+		}else
+			x++;
+	}
+}
+
+static void write_frames(pixel_stream &src, ap_uint<8> *out, uint16_t frames, uint16_t width, uint16_t height){
+	uint64_t pixels = (uint64_t) frames * width * height;
+
+	for (uint64_t i = 0; i < pixels; i++){
+#pragma HLS PIPELINE II=1
+		out[i] = src.read().data & 0xFF;
+	}
+}
+
+void canny_batch(const ap_uint<32> *in, ap_uint<8> *out, uint16_t frames, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode, uint16_t& thresholds){
+#pragma HLS INTERFACE m_axi port=in offset=slave bundle=frames max_read_burst_length=256
+#pragma HLS INTERFACE m_axi port=out offset=slave bundle=edges max_write_burst_length=256
+#pragma HLS INTERFACE s_axilite port=in
+#pragma HLS INTERFACE s_axilite port=out
+#pragma HLS INTERFACE s_axilite port=frames
+#pragma HLS INTERFACE s_axilite port=mask
+#pragma HLS INTERFACE s_axilite port=width
+#pragma HLS INTERFACE s_axilite port=height
+#pragma HLS INTERFACE s_axilite port=thres_mode
+#pragma HLS INTERFACE s_axilite port=high_set
+#pragma HLS INTERFACE s_axilite port=low_set
+#pragma HLS INTERFACE s_axilite port=hyst_mode
+#pragma HLS INTERFACE s_axilite port=thresholds
+#pragma HLS INTERFACE s_axilite port=return
+#pragma HLS DATAFLOW
+
+	pixel_stream src, dst;
+#pragma HLS STREAM variable=src depth=CHAIN_DEPTH
+#pragma HLS STREAM variable=dst depth=CHAIN_DEPTH
+
+	read_frames(in, src, frames, width, height);
+	canny_chain<1, pixel_data, grey_data>(src, dst, (uint64_t) frames * width * height, mask, width, height,
+			thres_mode, high_set, low_set, hyst_mode, &thresholds);
+	write_frames(dst, out, frames, width, height);
+}
+
+// Row spans for the host row-band engine. Same per-pixel kernels as the
+// stages, on the state of the band instead of the statics.
+
+void canny_row(span_state& s, const uint32_t *rgba, uint8_t *out, uint16_t y, uint16_t width, uint16_t height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, data_bool count){
+
+	for (uint16_t x = 0; x < width; x++){
+		uint8_t value = greyscale_px(rgba[x]);
+		value = gauss_px(s.gauss_buff, s.gauss_win, value, x, y, width, height);
+
+		direction dir = sobel_px(s.sobel_buff, s.sobel_win, value, x, y, mask, width, height);
+		if(count && y>2 && x>2)
+			s.bins[value]++;
+
+		value = suppression_px(s.supp_buff, s.supp_win, s.dir_buff, value, dir, x, y, width, height);
+		value = threshold_px(value, x, y, high, low);
+		if(hyst_mode != HYST_EXACT)
+			value = hysteresis_px(s.hyst_buff, s.hyst_win, value, x, y, width, height);
+		out[x] = value;
+	}
+}
+
+// The sobel stage scans the histogram of the previous frame over the first
+// 256 pixels and sends HIGH and LOW at pixels 0 and 1 of row THRES_ROW.
+// Frames narrower than 64 pixels send them before the scan completed, so
+// with the thresholds of the scan before.
+void frame_thresholds(magnitude_hist<1>& h, uint32_t mask, uint8_t thres_mode, uint8_t high_set, uint8_t low_set,
+		uint16_t width, uint8_t& high, uint8_t& low, uint16_t& thresholds){
+
+	uint8_t hi, lo;
+	select_thresholds(h, mask, thres_mode, high_set, low_set, hi, lo, thresholds);
+
+	hist_start(h);
+	for (int i = 0; i < 256; i++)
+		hist_scan(h);
+	select_thresholds(h, mask, thres_mode, high_set, low_set, high, low, thresholds);
+	if(THRES_ROW * (uint32_t) width < 256){
+		high = hi;
+		low = lo;
+	}
+}
+
+void hysteresis_row(hyst_state& h, uint8_t *row, uint16_t y, uint16_t width, uint16_t height){
 
-	write_pixel(dst, p, x, y);
+	if(y == 0)
+		hyst_start(h);
+	for (uint16_t x = 0; x < width; x++)
+		row[x] = hyst_exact_px(h, row[x], x, y, width, height);
 }
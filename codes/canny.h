@@ -0,0 +1,380 @@
+/* Canny edge detection stages for AXI4-Stream video
+ */
+
+#ifndef CANNY_H
+#define CANNY_H
+
+#include <stdint.h>
+#include <iostream>
+#include <hls_stream.h>
+#include <ap_axi_sdata.h>
+#include <hls_video.h>
+#include <math.h>
+#include <ap_fixed.h>
+
+// Largest frame the line buffers hold, the active frame size is set at
+// run time through the width and height registers of the stages
+#ifndef MAX_WIDTH
+#define MAX_WIDTH  1920
+#endif
+#ifndef MAX_HEIGHT
+#define MAX_HEIGHT 1080
+#endif
+#define HIGH 80
+#define LOW 20
+// Threshold modes of the sobel stage, the automatic modes derive HIGH and
+// LOW for the next frame from the magnitude histogram of the current one
+#define THRES_FIXED 0
+#define THRES_PERCENTILE 1
+#define THRES_OTSU 2
+// Percentiles of the magnitude histogram for HIGH and LOW, in 1/256
+#define HIGH_PCT 230
+#define LOW_PCT 192
+// Row whose pixels 0 and 1 carry HIGH and LOW from sobel to threshold
+#define THRES_ROW 4
+#define WEAK 75
+#define STRONG 255
+// Hysteresis modes: 3x3 window, or exact edge tracking over connected
+// components which outputs a frame late
+#define HYST_WINDOW 0
+#define HYST_EXACT 1
+// The exact hysteresis stores the classes of a whole frame, more block RAM
+// than the PYNQ-Z2 has at 1080p. Only builds with HYST_EXACT_ENABLE carry
+// it, in the hysteresis_exact tops and behind hyst_mode of the chain tops.
+#ifndef HYST_EXACT_ENABLE
+#define HYST_EXACT_ENABLE 0
+#endif
+// Run slots of a row in the exact hysteresis, a run and the gap after it
+// take two pixels
+#define HYST_SLOTS (MAX_WIDTH/2+2)
+// Union by rank keeps the run trees of a row within HYST_HOPS levels
+#define HYST_HOPS 11
+#if (1 << HYST_HOPS) < HYST_SLOTS
+#error "HYST_HOPS too small for MAX_WIDTH"
+#endif
+// Sets per frame of the exact hysteresis that start without touching the
+// row above, the weak pixels of any further ones are dropped
+#ifndef HYST_SETS
+#define HYST_SETS 32767
+#endif
+// CORDIC iterations of sobel mask 1, 2 to 10, canny_sweep compares counts
+#ifndef CORDIC_ITERATIONS
+#define CORDIC_ITERATIONS 10
+#endif
+// Gaussian smoothing: 0 = 5x5 kernel normalized by 273, 3/5/7/9 = separable
+// binomial kernel of that size, normalized by a shift
+#ifndef GAUSS_SIZE
+#define GAUSS_SIZE 0
+#endif
+// FIFO depth between the processes of the dataflow top
+#define CHAIN_DEPTH 2
+
+typedef ap_axiu<32,1,1,1> pixel_data;
+typedef hls::stream<pixel_data> pixel_stream;
+// TUSER[0] is start of frame, TUSER[2:1] the gradient direction from sobel8
+// to suppression8
+typedef ap_axiu<8,3,1,1> grey_data;
+typedef hls::stream<grey_data> grey_stream;
+// Multi-camera chain: up to CAMERAS streams interleaved by rows, TDEST
+// carrying the camera
+#define CAMERAS 4
+#define CAMERA_BITS 2
+typedef ap_axiu<32,1,1,CAMERA_BITS> cam_pixel_data;
+typedef hls::stream<cam_pixel_data> cam_pixel_stream;
+typedef ap_axiu<8,3,1,CAMERA_BITS> cam_grey_data;
+typedef hls::stream<cam_grey_data> cam_grey_stream;
+
+// Pixels per clock of the wide-beat pipeline. Lines fill whole beats, so the
+// active width has to be a multiple of the pixels per clock, the stages do
+// not pad a partial last beat.
+#define PPC 4
+
+// Beats carrying N pixels of one line, lane k in bits [B*k+B-1 : B*k] and
+// the direction of lane k in TUSER[2*k+2 : 2*k+1]
+template<int N>
+struct ppc_types {
+	typedef ap_axiu<32*N,1,1,1> rgba_beat;
+	typedef hls::stream<rgba_beat> rgba_stream;
+	typedef ap_axiu<8*N,1+2*N,1,1> grey_beat;
+	typedef hls::stream<grey_beat> grey_stream;
+};
+typedef ppc_types<PPC>::rgba_stream rgba_beat_stream;
+typedef ppc_types<PPC>::grey_stream grey_beat_stream;
+typedef uint8_t linebuffer2[2][MAX_WIDTH];
+typedef uint8_t linebuffer4[4][MAX_WIDTH];
+// Gradient direction quantized for non-maximum suppression: 0 horizontal,
+// 1 diagonal at 45 degrees, 2 vertical, 3 diagonal at 135 degrees. It travels
+// in-band with the magnitude, in RGBA bits [25:24] or in the grey TUSER.
+typedef ap_uint<2> direction;
+typedef direction dirbuffer[2][MAX_WIDTH];
+typedef uint8_t windowbuffer3[3][3];
+typedef uint8_t windowbuffer5[5][5];
+typedef ap_uint<1> data_bool;
+#if GAUSS_SIZE
+typedef uint8_t gauss_linebuffer[GAUSS_SIZE-1][MAX_WIDTH];
+typedef uint16_t gauss_window[GAUSS_SIZE];
+#else
+typedef linebuffer4 gauss_linebuffer;
+typedef windowbuffer5 gauss_window;
+#endif
+#define GAUSS_ROWS (GAUSS_SIZE ? GAUSS_SIZE-1 : 4)
+
+// Fused front end: the Gaussian rows followed by two blurred rows
+#define FRONT_ROWS (GAUSS_ROWS+2)
+typedef uint8_t frontbuffer[FRONT_ROWS][MAX_WIDTH];
+
+// Exact hysteresis. Pass 1 labels the runs of weak and strong pixels of a
+// row and joins each to the sets of the runs it touches in the row above.
+// Run slots are recycled every other row, so the union-find only spans the
+// runs in flight. A run that touches nothing starts a new set, numbered in
+// raster order, and when two sets meet the younger links to the older.
+// Pass 2 replays the stored classes of the previous frame: a run takes the
+// verdict of the runs above it, or resolves the set it starts through its
+// link. One bank of set tables per frame.
+struct hyst_state {
+	uint8_t classes[MAX_HEIGHT][MAX_WIDTH/4];
+	uint16_t labels[MAX_WIDTH];
+	uint16_t parent[2][HYST_SLOTS];
+	uint8_t rank[2][HYST_SLOTS];
+	uint16_t fwd[2][HYST_SLOTS];
+	uint16_t set[2][HYST_SLOTS];
+	data_bool strong[2][HYST_SLOTS];
+	uint16_t link[2][HYST_SETS+1];
+	data_bool verdict[2][HYST_SETS+1];
+	data_bool bank;
+	uint16_t next, slots, slot, run, up_left, up;
+	uint8_t last;
+	data_bool touched;
+	// pass 2, class and run slot of the replayed row
+	uint16_t replay[MAX_WIDTH];
+	data_bool run_verdict[2][HYST_SLOTS];
+	uint16_t out_next, out_slots, out_up_left, out_up;
+	uint8_t out_last;
+	data_bool out_touched, out_verdict;
+};
+
+// Magnitude histograms of the sobel stage, one bank per lane. Set bank
+// counts the frame in flight, the other set is scanned and cleared. high,
+// low and otsu_high hold the thresholds of the last complete scan.
+template<int N>
+struct magnitude_hist {
+	uint32_t bins[2][N][256];
+	uint32_t count[2];
+	uint32_t sum[2];
+	data_bool bank;
+	uint16_t bin;
+	uint16_t fwd_bin[N];
+	uint32_t fwd_count[N];
+	uint32_t w0, s0;
+	float best;
+	uint8_t p_high, p_low, otsu;
+	uint8_t high, low, otsu_high;
+	data_bool valid;
+};
+
+// Performance counters of a stage, read back over s_axilite. Errors count
+// SOF inside a line and EOL at another column than on the previous line.
+struct perf_counters {
+	uint32_t frames;
+	uint32_t pixels;
+	uint32_t stall_in;
+	uint32_t stall_out;
+	uint32_t errors;
+	uint16_t line;
+};
+
+// State of a stage instance: the coordinates of the next pixel, the
+// counters and the line buffers. Every top and dataflow process keeps its
+// own in a static, the host keeps one per stream, so pipelines on
+// different streams can run side by side in a process.
+struct greyscale_state {
+	uint16_t x, y;
+	perf_counters counters;
+};
+
+struct gauss_state {
+	uint16_t x, y;
+	perf_counters counters;
+	gauss_linebuffer buffer;
+	gauss_window window;
+};
+
+template<int N>
+struct sobel_state {
+	uint16_t x, y;
+	perf_counters counters;
+	linebuffer2 buffer;
+	windowbuffer3 window;
+	magnitude_hist<N> hist;
+};
+
+struct front_state {
+	uint16_t x, y;
+	perf_counters counters;
+	frontbuffer buffer;
+	gauss_window gauss_win;
+	windowbuffer3 sobel_win;
+	magnitude_hist<1> hist;
+};
+
+struct suppression_state {
+	uint16_t x, y;
+	perf_counters counters;
+	linebuffer2 buffer;
+	windowbuffer3 window;
+	dirbuffer dir_buff;
+};
+
+// HIGH and LOW apply until the first frame latches its own
+struct threshold_state {
+	uint16_t x, y;
+	perf_counters counters;
+	uint8_t hi, lo;
+};
+#define THRESHOLD_STATE_INIT {0, 0, {0, 0, 0, 0, 0, 0}, HIGH, LOW}
+
+struct hysteresis_window_state {
+	uint16_t x, y;
+	perf_counters counters;
+	linebuffer2 buffer;
+	windowbuffer3 window;
+};
+
+#if HYST_EXACT_ENABLE
+struct hysteresis_state {
+	uint16_t x, y;
+	perf_counters counters;
+	linebuffer2 buffer;
+	windowbuffer3 window;
+	hyst_state hyst;
+};
+#else
+typedef hysteresis_window_state hysteresis_state;
+#endif
+
+// All stages of one pipeline on the host, too large for the stack. Zeroed
+// by new chain_state(), chain_init() then sets the reset thresholds.
+struct chain_state {
+	greyscale_state grey;
+	gauss_state gauss;
+	sobel_state<1> sobel;
+	front_state front;
+	suppression_state supp;
+	threshold_state thres;
+	hysteresis_state hyst;
+};
+
+inline void chain_init(chain_state& c){
+	c.thres.hi = HIGH;
+	c.thres.lo = LOW;
+}
+
+// Chain state of one band of rows in the host row-band engine. A band
+// starts HALO_ROWS rows early, by then the line buffers and windows of
+// every stage hold the same rows as in the stream and the output matches.
+#define HALO_ROWS (GAUSS_ROWS+6)
+struct span_state {
+	gauss_linebuffer gauss_buff;
+	gauss_window gauss_win;
+	linebuffer2 sobel_buff;
+	windowbuffer3 sobel_win;
+	linebuffer2 supp_buff;
+	windowbuffer3 supp_win;
+	dirbuffer dir_buff;
+	linebuffer2 hyst_buff;
+	windowbuffer3 hyst_win;
+	uint32_t bins[256];
+};
+
+// Stream processing functions, 32-bit RGBA between all stages
+void greyscale(pixel_stream &src, pixel_stream &dst, perf_counters& perf);
+void gauss(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+void sobel(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf);
+void suppression(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+void threshold(pixel_stream &src, pixel_stream &dst, perf_counters& perf);
+void hysteresis(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+
+// Stream processing functions, 8-bit grey between greyscale8 and hysteresis8
+void greyscale8(pixel_stream &src, grey_stream &dst, perf_counters& perf);
+void gauss8(grey_stream &src, grey_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+void sobel8(grey_stream &src, grey_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf);
+void suppression8(grey_stream &src, grey_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+void threshold8(grey_stream &src, grey_stream &dst, perf_counters& perf);
+void hysteresis8(grey_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+
+// Exact hysteresis, one frame late, in builds with HYST_EXACT_ENABLE
+void hysteresis_exact(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+void hysteresis_exact8(grey_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+
+// Fused greyscale, gauss and sobel front end, emits magnitude and direction
+void front(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf);
+void front8(pixel_stream &src, grey_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf);
+
+// Stages on a state of their own, for any number of pipelines in one host
+// process (instanced for pixel_stream and grey_stream between the stages)
+template<typename TO> data_bool greyscale_stage(greyscale_state& s, pixel_stream &src, hls::stream<TO> &dst, perf_counters& perf);
+template<typename T> data_bool gauss_stage(gauss_state& s, hls::stream<T> &src, hls::stream<T> &dst,
+		uint16_t width, uint16_t height, perf_counters& perf);
+template<typename T> data_bool sobel_stage(sobel_state<1>& s, hls::stream<T> &src, hls::stream<T> &dst, uint32_t mask,
+		uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set,
+		uint16_t& thresholds, perf_counters& perf);
+template<typename TO> data_bool front_stage(front_state& s, pixel_stream &src, hls::stream<TO> &dst, uint32_t mask,
+		uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set,
+		uint16_t& thresholds, perf_counters& perf);
+template<typename T> data_bool suppression_stage(suppression_state& s, hls::stream<T> &src, hls::stream<T> &dst,
+		uint16_t width, uint16_t height, perf_counters& perf);
+template<typename T> data_bool threshold_stage(threshold_state& s, hls::stream<T> &src, hls::stream<T> &dst, perf_counters& perf);
+template<typename TI, typename TO> data_bool hysteresis_stage(hysteresis_state& s, hls::stream<TI> &src, hls::stream<TO> &dst,
+		uint16_t width, uint16_t height, uint8_t hyst_mode, perf_counters& perf);
+
+// Stream processing functions, N pixels per clock (instanced for N = 1, 2, 4),
+// for widths that are a multiple of N
+template<int N> data_bool greyscale_ppc(typename ppc_types<N>::rgba_stream &src, typename ppc_types<N>::grey_stream &dst, perf_counters& perf);
+template<int N> data_bool gauss_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf);
+template<int N> data_bool sobel_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds, perf_counters& perf);
+template<int N> data_bool suppression_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf);
+template<int N> data_bool threshold_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::grey_stream &dst, perf_counters& perf);
+template<int N> data_bool hysteresis_ppc(typename ppc_types<N>::grey_stream &src, typename ppc_types<N>::rgba_stream &dst,
+		uint16_t width, uint16_t height, perf_counters& perf);
+
+// Synthesis tops of the PPC pixels per clock pipeline
+void greyscale_wide(rgba_beat_stream &src, grey_beat_stream &dst, perf_counters& perf);
+void gauss_wide(grey_beat_stream &src, grey_beat_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+void sobel_wide(grey_beat_stream &src, grey_beat_stream &dst, uint32_t mask,
+		uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set,
+		uint16_t& thresholds, perf_counters& perf);
+void suppression_wide(grey_beat_stream &src, grey_beat_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+void threshold_wide(grey_beat_stream &src, grey_beat_stream &dst, perf_counters& perf);
+void hysteresis_wide(grey_beat_stream &src, rgba_beat_stream &dst, uint16_t width, uint16_t height, perf_counters& perf);
+
+// Whole chain under DATAFLOW, one frame per start over the AXI-Lite control
+void canny(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode, uint16_t& thresholds);
+// Same chain for the interleaved rows of up to CAMERAS cameras, a line
+// buffer bank per camera selected by TDEST
+void canny_cams(cam_pixel_stream &src, cam_pixel_stream &dst, uint16_t frames, uint8_t cameras, uint32_t mask,
+		uint16_t width, uint16_t height, uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode,
+		uint16_t thresholds[CAMERAS]);
+// Same chain on frames in DDR, reads RGBA frames from in and writes one
+// edge byte per pixel to out
+void canny_batch(const ap_uint<32> *in, ap_uint<8> *out, uint16_t frames, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode, uint16_t& thresholds);
+
+// Host row-band engine: one row through the chain on the state of a band,
+// the thresholds of a frame from the histogram of the previous one and the
+// exact hysteresis over a row of threshold output
+void canny_row(span_state& s, const uint32_t *rgba, uint8_t *out, uint16_t y, uint16_t width, uint16_t height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, data_bool count);
+void frame_thresholds(magnitude_hist<1>& h, uint32_t mask, uint8_t thres_mode, uint8_t high_set, uint8_t low_set,
+		uint16_t width, uint8_t& high, uint8_t& low, uint16_t& thresholds);
+void hysteresis_row(hyst_state& h, uint8_t *row, uint16_t y, uint16_t width, uint16_t height);
+
+#endif // CANNY_H
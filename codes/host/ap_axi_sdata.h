@@ -0,0 +1,20 @@
+/* Host stand-in for the Vivado HLS AXI4-Stream side-channel types
+ */
+
+#ifndef HOST_AP_AXI_SDATA_H
+#define HOST_AP_AXI_SDATA_H
+
+#include "ap_int.h"
+
+template<int D, int U, int TI, int TD>
+struct ap_axiu {
+	ap_uint<D> data;
+	ap_uint<(D+7)/8> keep;
+	ap_uint<(D+7)/8> strb;
+	ap_uint<U> user;
+	ap_uint<1> last;
+	ap_uint<TI> id;
+	ap_uint<TD> dest;
+};
+
+#endif // HOST_AP_AXI_SDATA_H
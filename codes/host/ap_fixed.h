@@ -0,0 +1,12 @@
+/* Host stand-in for the Vivado HLS fixed point header
+ *
+ * The Canny stages only pull this in for the integer types, fixed point
+ * arithmetic is not modelled on the host.
+ */
+
+#ifndef HOST_AP_FIXED_H
+#define HOST_AP_FIXED_H
+
+#include "ap_int.h"
+
+#endif // HOST_AP_FIXED_H
@@ -0,0 +1,220 @@
+/* Host stand-in for the Vivado HLS arbitrary precision integer types
+ *
+ * Only the subset used by the Canny stages is provided: up to 64 bits the
+ * value is kept in a native word and truncated to W bits on every
+ * assignment, so wrap-around behaves like the synthesized datapath.
+ */
+
+#ifndef HOST_AP_INT_H
+#define HOST_AP_INT_H
+
+#include <stdint.h>
+
+// Smallest native word holding W bits, keeps the AXI side channels compact
+template<int W> struct ap_storage {
+	typedef ap_storage<(W <= 8 ? 8 : W <= 16 ? 16 : W <= 32 ? 32 : 64)> native;
+	typedef typename native::type type;
+	typedef typename native::stype stype;
+};
+template<> struct ap_storage<8> { typedef uint8_t type; typedef int8_t stype; };
+template<> struct ap_storage<16> { typedef uint16_t type; typedef int16_t stype; };
+template<> struct ap_storage<32> { typedef uint32_t type; typedef int32_t stype; };
+template<> struct ap_storage<64> { typedef uint64_t type; typedef int64_t stype; };
+
+template<bool B> struct ap_wide {};
+template<> struct ap_wide<true> { typedef void type; };
+
+// Assignable bit range of an ap_uint, as returned by range()
+template<typename T>
+class ap_range_ref {
+public:
+	ap_range_ref(T &v, int hi, int lo) : ref(v), hi(hi), lo(lo) {}
+
+	operator uint64_t() const { return ref.get_range(hi, lo); }
+	ap_range_ref& operator=(uint64_t v) { ref.set_range(hi, lo, v); return *this; }
+	ap_range_ref& operator=(const ap_range_ref &r) { return *this = (uint64_t) r; }
+
+private:
+	T &ref;
+	int hi, lo;
+};
+
+template<int W, typename Enable = void>
+class ap_uint {
+	static_assert(W > 0 && W <= 64, "host ap_uint supports 1 to 64 bits");
+
+public:
+	ap_uint() : val(0) {}
+	ap_uint(bool v) : val(v) {}
+	ap_uint(char v) : val(trunc(v)) {}
+	ap_uint(signed char v) : val(trunc(v)) {}
+	ap_uint(unsigned char v) : val(trunc(v)) {}
+	ap_uint(short v) : val(trunc(v)) {}
+	ap_uint(unsigned short v) : val(trunc(v)) {}
+	ap_uint(int v) : val(trunc(v)) {}
+	ap_uint(unsigned int v) : val(trunc(v)) {}
+	ap_uint(long v) : val(trunc(v)) {}
+	ap_uint(unsigned long v) : val(trunc(v)) {}
+	ap_uint(long long v) : val(trunc(v)) {}
+	ap_uint(unsigned long long v) : val(trunc(v)) {}
+	ap_uint(float v) : val(trunc((long long) v)) {}
+	ap_uint(double v) : val(trunc((long long) v)) {}
+	template<int W2> ap_uint(const ap_uint<W2> &v) : val(trunc((uint64_t) v)) {}
+	template<typename T> ap_uint(const ap_range_ref<T> &r) : val(trunc((uint64_t) r)) {}
+
+	operator uint64_t() const { return val; }
+
+	uint64_t to_uint64() const { return val; }
+	unsigned int to_uint() const { return (unsigned int) val; }
+	int length() const { return W; }
+
+	uint64_t get_range(int hi, int lo) const {
+		return (val >> lo) & mask(hi - lo + 1);
+	}
+
+	void set_range(int hi, int lo, uint64_t v) {
+		uint64_t m = mask(hi - lo + 1) << lo;
+		val = (val & ~m) | ((v << lo) & m);
+	}
+
+	uint64_t range(int hi, int lo) const { return get_range(hi, lo); }
+	ap_range_ref<ap_uint> range(int hi, int lo) { return ap_range_ref<ap_uint>(*this, hi, lo); }
+
+	bool operator[](int i) const { return (val >> i) & 1; }
+
+	ap_uint& operator+=(uint64_t v) { val = trunc(val + v); return *this; }
+	ap_uint& operator-=(uint64_t v) { val = trunc(val - v); return *this; }
+	ap_uint& operator&=(uint64_t v) { val &= v; return *this; }
+	ap_uint& operator|=(uint64_t v) { val = trunc(val | v); return *this; }
+	ap_uint& operator^=(uint64_t v) { val = trunc(val ^ v); return *this; }
+	ap_uint& operator<<=(int s) { val = trunc(val << s); return *this; }
+	ap_uint& operator>>=(int s) { val >>= s; return *this; }
+	ap_uint& operator++() { val = trunc(val + 1); return *this; }
+	ap_uint& operator--() { val = trunc(val - 1); return *this; }
+	ap_uint operator++(int) { ap_uint t = *this; ++*this; return t; }
+	ap_uint operator--(int) { ap_uint t = *this; --*this; return t; }
+
+private:
+	static uint64_t mask(int w) { return w >= 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << w) - 1); }
+	static uint64_t trunc(uint64_t v) { return v & mask(W); }
+
+	typename ap_storage<W>::type val;
+};
+
+// Wide words, only accessed lane by lane through range() when packing
+// several pixels into one AXI4-Stream beat
+template<int W>
+class ap_uint<W, typename ap_wide<(W > 64)>::type> {
+public:
+	ap_uint() { clear(); }
+	ap_uint(int v) { clear(); word[0] = (uint64_t)(int64_t) v; sext(v < 0); }
+	ap_uint(unsigned int v) { clear(); word[0] = v; }
+	ap_uint(long v) { clear(); word[0] = (uint64_t) v; sext(v < 0); }
+	ap_uint(unsigned long v) { clear(); word[0] = v; }
+	ap_uint(long long v) { clear(); word[0] = (uint64_t) v; sext(v < 0); }
+	ap_uint(unsigned long long v) { clear(); word[0] = v; }
+
+	int length() const { return W; }
+
+	uint64_t get_range(int hi, int lo) const {
+		if (hi / 64 == lo / 64 && hi - lo < 63)
+			return (word[lo / 64] >> (lo % 64)) & (((uint64_t) 1 << (hi - lo + 1)) - 1);
+		uint64_t v = 0;
+		for (int i = hi; i >= lo; i--)
+			v = (v << 1) | (*this)[i];
+		return v;
+	}
+
+	void set_range(int hi, int lo, uint64_t v) {
+		if (hi / 64 == lo / 64 && hi - lo < 63) {
+			uint64_t m = (((uint64_t) 1 << (hi - lo + 1)) - 1) << (lo % 64);
+			word[lo / 64] = (word[lo / 64] & ~m) | ((v << (lo % 64)) & m);
+			return;
+		}
+		for (int i = lo; i <= hi; i++, v >>= 1)
+			set_bit(i, v & 1);
+	}
+
+	uint64_t range(int hi, int lo) const { return get_range(hi, lo); }
+	ap_range_ref<ap_uint> range(int hi, int lo) { return ap_range_ref<ap_uint>(*this, hi, lo); }
+
+	bool operator[](int i) const { return (word[i / 64] >> (i % 64)) & 1; }
+
+	bool operator==(const ap_uint &o) const {
+		for (int i = 0; i < WORDS; i++)
+			if (word[i] != o.word[i])
+				return false;
+		return true;
+	}
+	bool operator!=(const ap_uint &o) const { return !(*this == o); }
+
+private:
+	enum { WORDS = (W + 63) / 64 };
+
+	void clear() {
+		for (int i = 0; i < WORDS; i++)
+			word[i] = 0;
+	}
+
+	void sext(bool negative) {
+		for (int i = 1; i < WORDS; i++)
+			word[i] = negative ? ~(uint64_t) 0 : 0;
+		if (W % 64)
+			word[WORDS - 1] &= ((uint64_t) 1 << (W % 64)) - 1;
+	}
+
+	void set_bit(int i, bool b) {
+		uint64_t m = (uint64_t) 1 << (i % 64);
+		word[i / 64] = b ? (word[i / 64] | m) : (word[i / 64] & ~m);
+	}
+
+	uint64_t word[WORDS];
+};
+
+template<int W>
+class ap_int {
+	static_assert(W > 0 && W <= 64, "host ap_int supports 1 to 64 bits");
+
+public:
+	ap_int() : val(0) {}
+	ap_int(bool v) : val(sext(v)) {}
+	ap_int(char v) : val(sext(v)) {}
+	ap_int(signed char v) : val(sext(v)) {}
+	ap_int(unsigned char v) : val(sext(v)) {}
+	ap_int(short v) : val(sext(v)) {}
+	ap_int(unsigned short v) : val(sext(v)) {}
+	ap_int(int v) : val(sext(v)) {}
+	ap_int(unsigned int v) : val(sext(v)) {}
+	ap_int(long v) : val(sext(v)) {}
+	ap_int(unsigned long v) : val(sext(v)) {}
+	ap_int(long long v) : val(sext(v)) {}
+	ap_int(unsigned long long v) : val(sext(v)) {}
+	ap_int(float v) : val(sext((long long) v)) {}
+	ap_int(double v) : val(sext((long long) v)) {}
+
+	operator int64_t() const { return val; }
+
+	int64_t to_int64() const { return val; }
+	int to_int() const { return (int) val; }
+	int length() const { return W; }
+
+	ap_int& operator+=(int64_t v) { val = sext(val + v); return *this; }
+	ap_int& operator-=(int64_t v) { val = sext(val - v); return *this; }
+	ap_int& operator++() { val = sext(val + 1); return *this; }
+	ap_int& operator--() { val = sext(val - 1); return *this; }
+	ap_int operator++(int) { ap_int t = *this; ++*this; return t; }
+	ap_int operator--(int) { ap_int t = *this; --*this; return t; }
+
+private:
+	static int64_t sext(uint64_t v) {
+		if (W == 64)
+			return (int64_t) v;
+		uint64_t m = ((uint64_t) 1 << W) - 1;
+		uint64_t s = (uint64_t) 1 << (W - 1);
+		return (int64_t) (((v & m) ^ s) - s);
+	}
+
+	typename ap_storage<W>::stype val;
+};
+
+#endif // HOST_AP_INT_H
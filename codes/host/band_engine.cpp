@@ -0,0 +1,104 @@
+/* Row-band engine, the Canny chain of canny.cpp on all cores
+ */
+
+#include <algorithm>
+#include "band_engine.h"
+
+
+band_engine::band_engine(int threads, uint32_t mask, uint8_t thres_mode, uint8_t high_set, uint8_t low_set,
+		uint8_t hyst_mode, simd_isa isa)
+	: isa(isa), thresholds(0), pool(threads), mask(mask), thres_mode(thres_mode), high_set(high_set), low_set(low_set),
+	hyst_mode(hyst_mode), high(HIGH), low(LOW), prev_high(HIGH), prev_low(LOW),
+	hist(new magnitude_hist<1>()), hyst(new hyst_state())
+{
+}
+
+
+/* Run rows first to last - 1 of a frame on a fresh chain state
+ *
+ * The halo rows before first come from the frame itself or, above its top,
+ * from the end of the previous frame with the thresholds that frame used.
+ * The first frame has nothing above its top, like the stream after reset.
+ *
+ * out  - threshold output with the exact hysteresis, edges otherwise
+ * bins - magnitude histogram of the rows of the band
+ */
+void band_engine::band(const uint32_t *rgba, std::vector<uint8_t> &out, int width, int height,
+		int first, int last, uint32_t bins[256])
+{
+	simd_row_fn row = simd_row(isa, width);
+	std::unique_ptr<span_state> s;
+	std::unique_ptr<simd_rows> v;
+	std::vector<uint8_t> halo(width);
+	bool above = prev.size() == (size_t)HALO_ROWS * width;
+
+	if (row)
+		v.reset(new simd_rows(width));
+	else
+		s.reset(new span_state());
+
+	for (int k = first - HALO_ROWS; k < last; k++)
+	{
+		if (k < 0 && !above)
+			continue;
+
+		const uint32_t *in = (k < 0) ? &prev[(size_t)(HALO_ROWS + k) * width] : &rgba[(size_t)k * width];
+		uint8_t *dst = (k < first) ? halo.data() : &out[(size_t)k * width];
+		int y = (k < 0) ? height + k : k;
+		uint8_t hi = (k < 0) ? prev_high : high, lo = (k < 0) ? prev_low : low;
+
+		if (row)
+			row(*v, in, dst, y, width, height, mask, hi, lo, hyst_mode, k >= first);
+		else
+			canny_row(*s, in, dst, y, width, height, mask, hi, lo, hyst_mode, k >= first);
+	}
+
+	if (row)
+		std::copy(v->bins, v->bins + 256, bins);
+	else
+		std::copy(s->bins, s->bins + 256, bins);
+}
+
+
+void band_engine::process(const uint32_t *rgba, std::vector<uint8_t> &edges, int width, int height)
+{
+	int bands = std::max(1, std::min(threads() * BANDS_PER_THREAD, height / MIN_BAND_ROWS));
+	std::vector<std::function<void()>> tasks;
+	std::vector<uint32_t> bins((size_t)bands * 256);
+
+	// HIGH and LOW of this frame from the histogram of the previous one
+	prev_high = high;
+	prev_low = low;
+	frame_thresholds(*hist, mask, thres_mode, high_set, low_set, width, high, low, thresholds);
+
+	edges.resize((size_t)width * height);
+	for (int b = 0; b < bands; b++)
+	{
+		int first = (int)((int64_t) height * b / bands);
+		int last = (int)((int64_t) height * (b + 1) / bands);
+		tasks.push_back([=, &edges, &bins]() {
+			band(rgba, edges, width, height, first, last, &bins[(size_t)b * 256]);
+		});
+	}
+	pool.run(tasks);
+
+	// Count the frame into the bank the next frame scans
+	for (int b = 0; b < bands; b++)
+		for (int v = 0; v < 256; v++)
+		{
+			uint32_t c = bins[(size_t)b * 256 + v];
+			hist->bins[hist->bank][0][v] += c;
+			hist->count[hist->bank] += c;
+			hist->sum[hist->bank] += c * v;
+		}
+
+	if (hyst_mode == HYST_EXACT)
+		for (int y = 0; y < height; y++)
+			hysteresis_row(*hyst, &edges[(size_t)y * width], y, width, height);
+
+	// frames with fewer rows than the halo start the next one without it
+	if (height >= HALO_ROWS)
+		prev.assign(rgba + (size_t)(height - HALO_ROWS) * width, rgba + (size_t)height * width);
+	else
+		prev.clear();
+}
@@ -0,0 +1,56 @@
+/* Row-band engine, the Canny chain of canny.cpp on all cores
+ *
+ * Every frame is split into horizontal bands which run in parallel on a
+ * work-stealing thread pool. A band replays the HALO_ROWS rows above it
+ * through the per-pixel kernels of the stages, which leaves the line
+ * buffers and windows exactly as in the stream, so the edges are byte for
+ * byte those of the single-threaded chain. The first band takes its halo
+ * from the last rows of the previous frame.
+ *
+ * The bands run on the AVX2 or AVX-512 row kernels of simd_rows.h when the
+ * CPU has them, else on canny_row() of canny.cpp.
+ */
+
+#ifndef BAND_ENGINE_H
+#define BAND_ENGINE_H
+
+#include <memory>
+#include <vector>
+#include "canny.h"
+#include "thread_pool.h"
+#include "simd_rows.h"
+
+// Bands queued per thread, the spare ones balance the load through stealing
+#define BANDS_PER_THREAD 2
+// Keeps the halo rows replayed by every band small against its own rows
+#define MIN_BAND_ROWS (4*HALO_ROWS)
+
+class band_engine {
+public:
+	band_engine(int threads, uint32_t mask, uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint8_t hyst_mode,
+			simd_isa isa = simd_detect());
+
+	// Run one frame of packed RGBA words, frames have to follow in stream order
+	void process(const uint32_t *rgba, std::vector<uint8_t> &edges, int width, int height);
+
+	int threads() const { return pool.size(); }
+	simd_isa isa;
+
+	// Thresholds of the last frame, as in the sobel register
+	uint16_t thresholds;
+
+private:
+	void band(const uint32_t *rgba, std::vector<uint8_t> &out, int width, int height,
+			int first, int last, uint32_t bins[256]);
+
+	thread_pool pool;
+	uint32_t mask;
+	uint8_t thres_mode, high_set, low_set, hyst_mode;
+	uint8_t high, low, prev_high, prev_low;
+	std::unique_ptr<magnitude_hist<1>> hist;
+	std::unique_ptr<hyst_state> hyst;
+	// last HALO_ROWS rows of the previous frame
+	std::vector<uint32_t> prev;
+};
+
+#endif // BAND_ENGINE_H
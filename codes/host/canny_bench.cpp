@@ -0,0 +1,229 @@
+/* Stage-level benchmark of the Canny C model
+ *
+ * Times every stage in isolation and the full chain on synthetic 720p,
+ * 1080p and 4K frames and on the given images, to catch performance
+ * regressions of the C model before synthesis.
+ *
+ * usage: canny_bench [-r repeats] [-n] [-b threads] [input.ppm ...]
+ * -n selects the 8-bit grey stream format between the stages, -b the threads
+ * of the row-band engine, one per core by default. Frames larger
+ * than MAX_WIDTH x MAX_HEIGHT do not fit the line buffers and are skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "canny.h"
+#include "canny_tops.h"
+#include "frame_io.h"
+#include "band_engine.h"
+
+
+// Frame to run the benchmark on
+struct bench_frame {
+	std::string name;
+	std::vector<uint32_t> rgba;
+	int width, height;
+};
+
+
+/* Peak resident set size of the process in MiB
+ */
+static double peakMemory()
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;
+}
+
+
+static void report(const bench_frame &frame, const char *stage, double sec, int repeats)
+{
+	double pixels = (double)frame.width * frame.height * repeats;
+	printf("%-16s %-14s %10.2f %10.2f %10.1f\n", frame.name.c_str(), stage,
+			sec * 1e9 / pixels, pixels / sec * 1e-6, peakMemory());
+}
+
+
+/* Time one stage over a captured frame
+ *
+ * The input is queued up front and drained afterwards, only the calls of
+ * the stage, one per pixel, are timed.
+ *
+ * in  - input beats of the stage
+ * out - output beats of the last repeat
+ */
+template<typename TI, typename TO, typename F>
+static double timeStage(F stage, const std::vector<TI> &in, std::vector<TO> &out, int repeats)
+{
+	hls::stream<TI> src;
+	hls::stream<TO> dst;
+	double sec = 0;
+
+	out.resize(in.size());
+	for (int r = 0; r < repeats; r++)
+	{
+		for (size_t i = 0; i < in.size(); i++)
+			src << in[i];
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < in.size(); i++)
+			stage(src, dst);
+		auto stop = std::chrono::steady_clock::now();
+		sec += std::chrono::duration<double>(stop - start).count();
+
+		for (size_t i = 0; i < out.size(); i++)
+			dst >> out[i];
+	}
+
+	return sec;
+}
+
+
+/* Benchmark the stages one by one, each on the output of the stage before,
+ * then the full chain in the lockstep schedule of canny_host
+ */
+template<typename T>
+static void benchFrame(const bench_frame &frame, int repeats, int threads)
+{
+	uint16_t width = frame.width, height = frame.height;
+	uint16_t thresholds;
+	perf_counters perf[6];
+	std::vector<pixel_data> src(frame.rgba.size()), dst;
+	std::vector<T> grey, blur, conv, suppress, thres;
+	hls::stream<T> s_grey, s_blur, s_conv, s_suppress, s_thres;
+	double sec;
+
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		src[i].data = frame.rgba[i];
+		src[i].keep = -1;
+		src[i].strb = -1;
+		src[i].user = (i == 0);
+		src[i].last = (i % width == (size_t)width - 1);
+		src[i].id = 0;
+		src[i].dest = 0;
+	}
+
+	sec = timeStage([&](pixel_stream &a, hls::stream<T> &b) { greyscale_any(a, b, perf[0]); },
+			src, grey, repeats);
+	report(frame, "greyscale", sec, repeats);
+
+	sec = timeStage([&](hls::stream<T> &a, hls::stream<T> &b) { gauss_any(a, b, width, height, perf[1]); },
+			grey, blur, repeats);
+	report(frame, "gauss", sec, repeats);
+
+	const char *sobel_names[5] = {"sobel mask 0", "sobel mask 1", "sobel mask 2", "sobel mask 3", "sobel mask 4"};
+	for (uint32_t mask = 0; mask < 5; mask++)
+	{
+		sec = timeStage([&](hls::stream<T> &a, hls::stream<T> &b) {
+				sobel_any(a, b, mask, width, height, THRES_FIXED, 0, 0, thresholds, perf[2]); },
+				blur, conv, repeats);
+		report(frame, sobel_names[mask], sec, repeats);
+	}
+
+	sec = timeStage([&](hls::stream<T> &a, hls::stream<T> &b) { suppression_any(a, b, width, height, perf[3]); },
+			conv, suppress, repeats);
+	report(frame, "suppression", sec, repeats);
+
+	sec = timeStage([&](hls::stream<T> &a, hls::stream<T> &b) { threshold_any(a, b, perf[4]); },
+			suppress, thres, repeats);
+	report(frame, "threshold", sec, repeats);
+
+	sec = timeStage([&](hls::stream<T> &a, pixel_stream &b) { hysteresis_any(a, b, width, height, HYST_WINDOW, perf[5]); },
+			thres, dst, repeats);
+	report(frame, "hysteresis", sec, repeats);
+
+	sec = timeStage([&](pixel_stream &a, pixel_stream &b) {
+			greyscale_any(a, s_grey, perf[0]);
+			gauss_any(s_grey, s_blur, width, height, perf[1]);
+			sobel_any(s_blur, s_conv, 1, width, height, THRES_FIXED, 0, 0, thresholds, perf[2]);
+			suppression_any(s_conv, s_suppress, width, height, perf[3]);
+			threshold_any(s_suppress, s_thres, perf[4]);
+			hysteresis_any(s_thres, b, width, height, HYST_WINDOW, perf[5]); },
+			src, dst, repeats);
+	report(frame, "chain", sec, repeats);
+
+	// the engine on the scalar kernels and on the widest vector ones
+	simd_isa isas[2] = {SIMD_SCALAR, simd_detect()};
+	for (int i = 0; i < (isas[1] == SIMD_SCALAR ? 1 : 2); i++)
+	{
+		band_engine engine(threads, 1, THRES_FIXED, 0, 0, HYST_WINDOW, isas[i]);
+		std::vector<uint8_t> edges;
+		auto start = std::chrono::steady_clock::now();
+		for (int r = 0; r < repeats; r++)
+			engine.process(frame.rgba.data(), edges, frame.width, frame.height);
+		auto stop = std::chrono::steady_clock::now();
+		std::string name = "bands x" + std::to_string(engine.threads()) + " " + simd_name(isas[i]);
+		report(frame, name.c_str(), std::chrono::duration<double>(stop - start).count(), repeats);
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	int repeats = 3;
+	int threads = std::thread::hardware_concurrency();
+	bool narrow = false;
+	std::vector<bench_frame> frames;
+	const int sizes[3][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+
+	for (int i = 0; i < 3; i++)
+	{
+		bench_frame frame;
+		frame.width = sizes[i][0];
+		frame.height = sizes[i][1];
+		frame.name = std::to_string(frame.width) + "x" + std::to_string(frame.height);
+		frames.push_back(frame);
+	}
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			repeats = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n"))
+			narrow = true;
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else
+		{
+			bench_frame frame;
+			frame.name = argv[i];
+			if (frame.name.find_last_of('/') != std::string::npos)
+				frame.name = frame.name.substr(frame.name.find_last_of('/') + 1);
+			if (!readPPM(argv[i], frame.rgba, frame.width, frame.height))
+			{
+				std::cout << "##### Invalid input image " << argv[i] << " #####" << std::endl;
+				return 1;
+			}
+			frames.push_back(frame);
+		}
+	}
+
+	printf("%d repeats, %s stream\n", repeats, narrow ? "8-bit" : "32-bit");
+	printf("%-16s %-14s %10s %10s %10s\n", "frame", "stage", "ns/pixel", "Mpixel/s", "peak MiB");
+
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		bench_frame &frame = frames[i];
+		if (frame.width > MAX_WIDTH || frame.height > MAX_HEIGHT)
+		{
+			printf("%-16s skipped, exceeds %dx%d\n", frame.name.c_str(), MAX_WIDTH, MAX_HEIGHT);
+			continue;
+		}
+		if (frame.rgba.empty())
+			synthFrame(frame.rgba, frame.width, frame.height);
+
+		if (narrow)
+			benchFrame<grey_data>(frame, repeats, threads);
+		else
+			benchFrame<pixel_data>(frame, repeats, threads);
+	}
+
+	return 0;
+}
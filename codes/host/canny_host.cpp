@@ -0,0 +1,336 @@
+/* Native host backend for the Canny stages
+ *
+ * Runs the stages of canny.cpp against the host stand-ins for the HLS
+ * headers, so the CPU produces the same edges as the FPGA overlay.
+ *
+ * usage: canny_host [-m mask] [-t mode] [-f frames] [-n] [-u] [-e] [-j] [-b threads] [-s] [-c cameras] [input.ppm] [output.pgm]
+ * Without an input image a synthetic MAX_WIDTH x MAX_HEIGHT frame is processed,
+ * -m selects the Sobel variant (0 to 4, see sobel_window_px in canny.cpp),
+ * -n selects the 8-bit grey stream format between the stages and -t the
+ * threshold mode of the sobel stage (0 fixed, 1 percentile, 2 Otsu), -u
+ * replaces greyscale, gauss and sobel by the fused front end and -e selects
+ * the exact hysteresis, which outputs a frame late. -j runs every stage on
+ * its own thread, -b the row-band engine on the given number of threads
+ * (0 for one per core) and -s keeps the engine on the scalar kernels.
+ * -c runs that many independent pipelines, one per camera and thread, each
+ * on the image with its own stage states.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <string>
+#include <vector>
+#include "canny.h"
+#include "frame_io.h"
+#include "band_engine.h"
+
+
+// Registers of the stage chain and the thresholds sobel computed
+struct chain_regs {
+	uint8_t mode, high_set, low_set;
+	uint16_t thresholds;
+	bool fused;
+	uint8_t hyst_mode;
+	perf_counters perf[6];
+	std::unique_ptr<chain_state> chain;
+};
+
+
+// FIFO depth between the stage threads
+#define THREAD_FIFO_DEPTH 1024
+
+
+static pixel_data makePixel(const std::vector<uint32_t> &rgba, size_t i, int width)
+{
+	pixel_data p;
+	p.data = rgba[i];
+	p.keep = -1;
+	p.strb = -1;
+	p.user = (i == 0);
+	p.last = (i % width == (size_t)width - 1);
+	p.id = 0;
+	p.dest = 0;
+	return p;
+}
+
+
+/* Invoke every stage once, in the 32-bit or the 8-bit stream format
+ */
+template<typename T>
+static void processPixel(pixel_stream &src, hls::stream<T> &grey, hls::stream<T> &blur, hls::stream<T> &conv,
+		hls::stream<T> &suppress, hls::stream<T> &thres, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		chain_regs &t)
+{
+	if (t.fused)
+		front_stage(t.chain->front, src, conv, mask, width, height, t.mode, t.high_set, t.low_set, t.thresholds, t.perf[0]);
+	else
+	{
+		greyscale_stage(t.chain->grey, src, grey, t.perf[0]);
+		gauss_stage(t.chain->gauss, grey, blur, width, height, t.perf[1]);
+		sobel_stage(t.chain->sobel, blur, conv, mask, width, height, t.mode, t.high_set, t.low_set, t.thresholds, t.perf[2]);
+	}
+	suppression_stage(t.chain->supp, conv, suppress, width, height, t.perf[3]);
+	threshold_stage(t.chain->thres, suppress, thres, t.perf[4]);
+	hysteresis_stage(t.chain->hyst, thres, dst, width, height, t.hyst_mode, t.perf[5]);
+}
+
+
+/* Run one frame through the stage chain
+ *
+ * Pixels are pushed one at a time and every stage is invoked once per
+ * pixel, the same lockstep schedule as processStream() in the streamulator.
+ */
+template<typename T>
+static void processFrame(const std::vector<uint32_t> &rgba, std::vector<uint8_t> &edges,
+		int width, int height, uint32_t mask, chain_regs &t)
+{
+	pixel_stream src, dst;
+	hls::stream<T> grey, blur, conv, suppress, thres;
+	pixel_data p;
+
+	edges.resize(rgba.size());
+	for (size_t i = 0; i < rgba.size(); i++)
+	{
+		src << makePixel(rgba, i, width);
+
+		processPixel(src, grey, blur, conv, suppress, thres, dst, mask, width, height, t);
+
+		dst >> p;
+		edges[i] = p.data & 0xFF;
+	}
+}
+
+
+/* Call a stage until it has taken the given number of pixels, yielding
+ * whenever it stalls on an empty input or a full output
+ */
+template<typename F>
+static void runStage(F stage, perf_counters &perf, size_t pixels)
+{
+	for (size_t n = 0; n < pixels; )
+	{
+		uint32_t before = perf.pixels;
+		stage();
+		if (perf.pixels != before)
+			n++;
+		else
+			std::this_thread::yield();
+	}
+}
+
+
+/* Run one frame through the stage chain, every stage on its own thread
+ *
+ * The streams are bounded lock-free FIFOs between the threads. HIGH and
+ * LOW travel in-band from sobel to threshold, so the edges are identical
+ * to the lockstep schedule.
+ */
+template<typename T>
+static void processFrameThreaded(const std::vector<uint32_t> &rgba, std::vector<uint8_t> &edges,
+		int width, int height, uint32_t mask, chain_regs &t)
+{
+	pixel_stream src, dst;
+	hls::stream<T> grey, blur, conv, suppress, thres;
+	std::vector<std::thread> threads;
+	size_t pixels = rgba.size();
+	uint16_t w = width, h = height;
+
+	src.set_depth(THREAD_FIFO_DEPTH);
+	dst.set_depth(THREAD_FIFO_DEPTH);
+	grey.set_depth(THREAD_FIFO_DEPTH);
+	blur.set_depth(THREAD_FIFO_DEPTH);
+	conv.set_depth(THREAD_FIFO_DEPTH);
+	suppress.set_depth(THREAD_FIFO_DEPTH);
+	thres.set_depth(THREAD_FIFO_DEPTH);
+
+	threads.push_back(std::thread([&]() {
+		for (size_t i = 0; i < pixels; i++)
+			src << makePixel(rgba, i, width);
+	}));
+
+	if (t.fused)
+		threads.push_back(std::thread([&]() {
+			runStage([&]() {
+				front_stage(t.chain->front, src, conv, mask, w, h, t.mode, t.high_set, t.low_set, t.thresholds, t.perf[0]);
+			}, t.perf[0], pixels);
+		}));
+	else
+	{
+		threads.push_back(std::thread([&]() {
+			runStage([&]() { greyscale_stage(t.chain->grey, src, grey, t.perf[0]); }, t.perf[0], pixels);
+		}));
+		threads.push_back(std::thread([&]() {
+			runStage([&]() { gauss_stage(t.chain->gauss, grey, blur, w, h, t.perf[1]); }, t.perf[1], pixels);
+		}));
+		threads.push_back(std::thread([&]() {
+			runStage([&]() {
+				sobel_stage(t.chain->sobel, blur, conv, mask, w, h, t.mode, t.high_set, t.low_set, t.thresholds, t.perf[2]);
+			}, t.perf[2], pixels);
+		}));
+	}
+
+	threads.push_back(std::thread([&]() {
+		runStage([&]() { suppression_stage(t.chain->supp, conv, suppress, w, h, t.perf[3]); }, t.perf[3], pixels);
+	}));
+	threads.push_back(std::thread([&]() {
+		runStage([&]() { threshold_stage(t.chain->thres, suppress, thres, t.perf[4]); }, t.perf[4], pixels);
+	}));
+	threads.push_back(std::thread([&]() {
+		runStage([&]() { hysteresis_stage(t.chain->hyst, thres, dst, w, h, t.hyst_mode, t.perf[5]); }, t.perf[5], pixels);
+	}));
+
+	edges.resize(pixels);
+	for (size_t i = 0; i < pixels; i++)
+		edges[i] = dst.read().data & 0xFF;
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+}
+
+
+int main(int argc, char **argv)
+{
+	uint32_t mask = 1;
+	int frames = 1;
+	int bands = -1;
+	int cameras = 0;
+	bool narrow = false, threaded = false, scalar = false;
+	chain_regs t = {THRES_FIXED, 0, 0, 0, false, HYST_WINDOW, {}, {}};
+	std::string input, output = "edges.pgm";
+	std::vector<std::string> args;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-m") && i + 1 < argc)
+			mask = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			t.mode = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-n"))
+			narrow = true;
+		else if (!strcmp(argv[i], "-u"))
+			t.fused = true;
+		else if (!strcmp(argv[i], "-e"))
+			t.hyst_mode = HYST_EXACT;
+		else if (!strcmp(argv[i], "-j"))
+			threaded = true;
+		else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+			bands = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s"))
+			scalar = true;
+		else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+			cameras = atoi(argv[++i]);
+		else
+			args.push_back(argv[i]);
+	}
+	if (args.size() > 0)
+		input = args[0];
+	if (args.size() > 1)
+		output = args[1];
+
+	std::vector<uint32_t> rgba;
+	std::vector<uint8_t> edges;
+	int width = MAX_WIDTH, height = MAX_HEIGHT;
+
+	if (input.empty())
+		synthFrame(rgba, width, height);
+	else if (!readPPM(input, rgba, width, height))
+	{
+		std::cout << "##### Invalid input image " << input << " #####" << std::endl;
+		return 1;
+	}
+
+	if (width > MAX_WIDTH || height > MAX_HEIGHT)
+	{
+		std::cout << "##### Image exceeds " << MAX_WIDTH << "x" << MAX_HEIGHT << " #####" << std::endl;
+		return 1;
+	}
+
+	if (cameras > 1 && (bands >= 0 || threaded))
+	{
+		std::cout << "##### -c runs the lockstep chain, not with -b or -j #####" << std::endl;
+		return 1;
+	}
+
+	std::unique_ptr<band_engine> engine;
+	if (bands >= 0)
+		engine.reset(new band_engine(bands ? bands : std::thread::hardware_concurrency(),
+				mask, t.mode, t.high_set, t.low_set, t.hyst_mode, scalar ? SIMD_SCALAR : simd_detect()));
+
+	t.chain.reset(new chain_state());
+	chain_init(*t.chain);
+
+	// Pipelines of the other cameras, camera 0 runs on t
+	std::vector<chain_regs> rigs(cameras > 1 ? cameras - 1 : 0);
+	std::vector<std::vector<uint8_t>> rig_edges(rigs.size());
+	std::vector<std::thread> rig_threads;
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t c = 0; c < rigs.size(); c++)
+		rig_threads.push_back(std::thread([&, c]() {
+			chain_regs &r = rigs[c];
+			r.mode = t.mode;
+			r.high_set = t.high_set;
+			r.low_set = t.low_set;
+			r.fused = t.fused;
+			r.hyst_mode = t.hyst_mode;
+			r.chain.reset(new chain_state());
+			chain_init(*r.chain);
+			for (int frame = 0; frame < frames; frame++)
+				if (narrow)
+					processFrame<grey_data>(rgba, rig_edges[c], width, height, mask, r);
+				else
+					processFrame<pixel_data>(rgba, rig_edges[c], width, height, mask, r);
+		}));
+	for (int frame = 0; frame < frames; frame++)
+		if (engine)
+			engine->process(rgba.data(), edges, width, height);
+		else if (threaded && narrow)
+			processFrameThreaded<grey_data>(rgba, edges, width, height, mask, t);
+		else if (threaded)
+			processFrameThreaded<pixel_data>(rgba, edges, width, height, mask, t);
+		else if (narrow)
+			processFrame<grey_data>(rgba, edges, width, height, mask, t);
+		else
+			processFrame<pixel_data>(rgba, edges, width, height, mask, t);
+	for (size_t c = 0; c < rig_threads.size(); c++)
+		rig_threads[c].join();
+	auto stop = std::chrono::steady_clock::now();
+
+	for (size_t c = 0; c < rigs.size(); c++)
+		if (rig_edges[c] != edges)
+		{
+			std::cout << "##### Camera " << c + 1 << " differs from camera 0 #####" << std::endl;
+			return 1;
+		}
+
+	double sec = std::chrono::duration<double>(stop - start).count();
+	double pixels = (double)width * height * frames * std::max(cameras, 1);
+	std::cout << width << "x" << height << " x " << frames << " frames, mask " << mask << (narrow ? ", 8-bit" : ", 32-bit")
+			<< (t.fused ? ", fused front end" : "") << (t.hyst_mode == HYST_EXACT ? ", exact hysteresis" : "")
+			<< (threaded ? ", threaded" : "") << (cameras > 1 ? ", " + std::to_string(cameras) + " cameras" : "")
+			<< (engine ? ", " + std::to_string(engine->threads()) + " band threads, " + simd_name(engine->isa) : "") << ": "
+			<< sec * 1e3 / frames << " ms/frame, " << pixels / sec * 1e-6 << " Mpixel/s, "
+			<< frames * std::max(cameras, 1) / sec << " fps" << std::endl;
+	if (engine)
+		t.thresholds = engine->thresholds;
+	std::cout << "thresholds: HIGH " << (t.thresholds & 0xFF) << ", LOW " << (t.thresholds >> 8) << std::endl;
+	const char *stages[6] = {t.fused ? "front" : "greyscale", "gauss", "sobel", "suppression", "threshold", "hysteresis"};
+	for (int i = 0; i < 6; i++)
+		if (t.perf[i].pixels)
+			std::cout << stages[i] << ": " << t.perf[i].frames << " frames, " << t.perf[i].pixels << " pixels, "
+					<< t.perf[i].errors << " framing errors" << std::endl;
+
+	if (!writePGM(output, edges, width, height))
+	{
+		std::cout << "##### Could not write " << output << " #####" << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
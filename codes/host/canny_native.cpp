@@ -0,0 +1,442 @@
+/* Python bindings of the Canny stages and the chain
+ *
+ * Every stage of canny.cpp and the full chain as functions of the canny_native
+ * module, for the reference notebooks in python_implementation. Images are
+ * taken through the buffer protocol, NumPy uint8 arrays of shape (H, W) or
+ * (H, W, C) in any layout, and read in place, except that canny packs all
+ * but contiguous RGBA images into words for the row-band engine. The
+ * results are new (H, W) uint8 buffers, np.asarray wraps them without a copy.
+ *
+ * The stages run one frame from reset, as on the stream, so their outputs
+ * lag the input like in hardware: the Gaussian by 2 rows and columns, sobel,
+ * suppression and the hysteresis window by 1 each.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "canny.h"
+#include "band_engine.h"
+
+
+// Image of the caller, borrowed for the duration of a call
+struct image_view {
+	Py_buffer view;
+	int width, height, channels;
+
+	image_view() { view.obj = NULL; }
+	~image_view() { if (view.obj) PyBuffer_Release(&view); }
+
+	uint8_t at(int x, int y, int c = 0) const {
+		const char *p = (const char*) view.buf + y * view.strides[0] + x * view.strides[1];
+		return *(const uint8_t*) ((view.ndim == 3) ? p + c * view.strides[2] : p);
+	}
+};
+
+
+/* Borrow an (H, W) or (H, W, C) uint8 image, color images need 3 or 4 channels
+ */
+static bool getImage(PyObject *obj, image_view &image, const char *name, bool color)
+{
+	if (PyObject_GetBuffer(obj, &image.view, PyBUF_STRIDES | PyBUF_FORMAT) < 0)
+		return false;
+
+	Py_buffer &v = image.view;
+	if (v.itemsize != 1 || (v.format && strcmp(v.format, "B") && strcmp(v.format, "b") && strcmp(v.format, "c")))
+	{
+		PyErr_Format(PyExc_TypeError, "%s must be an array of uint8", name);
+		return false;
+	}
+	if (v.ndim != 2 && v.ndim != 3)
+	{
+		PyErr_Format(PyExc_ValueError, "%s must have shape (H, W) or (H, W, C)", name);
+		return false;
+	}
+
+	image.height = v.shape[0];
+	image.width = v.shape[1];
+	image.channels = (v.ndim == 3) ? v.shape[2] : 1;
+	if (color && image.channels != 3 && image.channels != 4)
+	{
+		PyErr_Format(PyExc_ValueError, "%s must have shape (H, W, 3) or (H, W, 4)", name);
+		return false;
+	}
+	if (image.width < 1 || image.height < 1 || image.width > MAX_WIDTH || image.height > MAX_HEIGHT)
+	{
+		PyErr_Format(PyExc_ValueError, "%s is %dx%d, the line buffers hold up to %dx%d", name,
+				image.width, image.height, MAX_WIDTH, MAX_HEIGHT);
+		return false;
+	}
+	return true;
+}
+
+
+/* New (H, W) uint8 buffer, a memoryview over a bytearray that NumPy wraps
+ * in place
+ */
+static PyObject *newImage(int width, int height, uint8_t *&data)
+{
+	PyObject *bytes = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t) width * height);
+	if (!bytes)
+		return NULL;
+	data = (uint8_t*) PyByteArray_AS_STRING(bytes);
+
+	PyObject *view = PyMemoryView_FromObject(bytes);
+	Py_DECREF(bytes);
+	if (!view)
+		return NULL;
+
+	PyObject *image = PyObject_CallMethod(view, "cast", "s(ii)", "B", height, width);
+	Py_DECREF(view);
+	return image;
+}
+
+
+/* RGBA word of a pixel, grey images repeat their value in red, green and blue
+ */
+static uint32_t rgbaWord(const image_view &image, int x, int y)
+{
+	if (image.channels < 3)
+	{
+		uint32_t v = image.at(x, y);
+		return 0xFF000000 | (v << 16) | (v << 8) | v;
+	}
+	return 0xFF000000 | (image.at(x, y, 2) << 16) | (image.at(x, y, 1) << 8) | image.at(x, y, 0);
+}
+
+
+template<typename T>
+static T beat(uint32_t data, int x, int y, int width)
+{
+	T p;
+	p.data = data;
+	p.keep = -1;
+	p.strb = -1;
+	p.user = (x == 0 && y == 0);
+	p.last = (x == width - 1);
+	p.id = 0;
+	p.dest = 0;
+	return p;
+}
+
+
+/* Run a frame through a stage, a beat in and a beat out per pixel
+ *
+ * in    - input beat of a pixel
+ * stage - the stage on the input and output stream
+ * out   - stores an output beat
+ */
+template<typename TI, typename TO, typename I, typename S, typename O>
+static void runStage(int width, int height, I in, S stage, O out)
+{
+	hls::stream<TI> src;
+	hls::stream<TO> dst;
+
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			src << in(x, y);
+			stage(src, dst);
+			out(dst.read(), (size_t) y * width + x);
+		}
+}
+
+
+static PyObject *py_greyscale(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"image", NULL};
+	PyObject *obj;
+	image_view image;
+	uint8_t *grey;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", (char**) keywords, &obj) || !getImage(obj, image, "image", true))
+		return NULL;
+	PyObject *result = newImage(image.width, image.height, grey);
+	if (!result)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	std::unique_ptr<greyscale_state> s(new greyscale_state());
+	perf_counters perf;
+	runStage<pixel_data, grey_data>(image.width, image.height,
+			[&](int x, int y) { return beat<pixel_data>(rgbaWord(image, x, y), x, y, image.width); },
+			[&](pixel_stream &src, grey_stream &dst) { greyscale_stage(*s, src, dst, perf); },
+			[&](const grey_data &p, size_t i) { grey[i] = p.data; });
+	Py_END_ALLOW_THREADS
+
+	return result;
+}
+
+
+static PyObject *py_gauss(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"image", NULL};
+	PyObject *obj;
+	image_view image;
+	uint8_t *blur;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", (char**) keywords, &obj) || !getImage(obj, image, "image", false))
+		return NULL;
+	PyObject *result = newImage(image.width, image.height, blur);
+	if (!result)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	std::unique_ptr<gauss_state> s(new gauss_state());
+	perf_counters perf;
+	runStage<grey_data, grey_data>(image.width, image.height,
+			[&](int x, int y) { return beat<grey_data>(image.at(x, y), x, y, image.width); },
+			[&](grey_stream &src, grey_stream &dst) { gauss_stage(*s, src, dst, image.width, image.height, perf); },
+			[&](const grey_data &p, size_t i) { blur[i] = p.data; });
+	Py_END_ALLOW_THREADS
+
+	return result;
+}
+
+
+static PyObject *py_sobel(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"image", "mask", NULL};
+	PyObject *obj;
+	unsigned int mask = 1;
+	image_view image;
+	uint8_t *magnitude, *direction;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|I", (char**) keywords, &obj, &mask)
+			|| !getImage(obj, image, "image", false))
+		return NULL;
+	PyObject *mag = newImage(image.width, image.height, magnitude);
+	if (!mag)
+		return NULL;
+	PyObject *dir = newImage(image.width, image.height, direction);
+	if (!dir)
+	{
+		Py_DECREF(mag);
+		return NULL;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	std::unique_ptr<sobel_state<1>> s(new sobel_state<1>());
+	perf_counters perf;
+	uint16_t thresholds;
+	runStage<grey_data, grey_data>(image.width, image.height,
+			[&](int x, int y) { return beat<grey_data>(image.at(x, y), x, y, image.width); },
+			[&](grey_stream &src, grey_stream &dst) {
+				sobel_stage(*s, src, dst, mask, image.width, image.height, THRES_FIXED, 0, 0, thresholds, perf); },
+			[&](const grey_data &p, size_t i) {
+				magnitude[i] = p.data;
+				direction[i] = p.user >> 1; });
+	Py_END_ALLOW_THREADS
+
+	return Py_BuildValue("(NN)", mag, dir);
+}
+
+
+static PyObject *py_suppression(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"magnitude", "direction", NULL};
+	PyObject *obj_mag, *obj_dir;
+	image_view mag, dir;
+	uint8_t *thin;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OO", (char**) keywords, &obj_mag, &obj_dir)
+			|| !getImage(obj_mag, mag, "magnitude", false) || !getImage(obj_dir, dir, "direction", false))
+		return NULL;
+	if (mag.width != dir.width || mag.height != dir.height)
+	{
+		PyErr_SetString(PyExc_ValueError, "magnitude and direction differ in size");
+		return NULL;
+	}
+	PyObject *result = newImage(mag.width, mag.height, thin);
+	if (!result)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	std::unique_ptr<suppression_state> s(new suppression_state());
+	perf_counters perf;
+	runStage<grey_data, grey_data>(mag.width, mag.height,
+			[&](int x, int y) {
+				grey_data p = beat<grey_data>(mag.at(x, y), x, y, mag.width);
+				p.user = p.user | ((dir.at(x, y) & 3) << 1);
+				return p; },
+			[&](grey_stream &src, grey_stream &dst) { suppression_stage(*s, src, dst, mag.width, mag.height, perf); },
+			[&](const grey_data &p, size_t i) { thin[i] = p.data; });
+	Py_END_ALLOW_THREADS
+
+	return result;
+}
+
+
+static PyObject *py_threshold(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"image", "high", "low", NULL};
+	PyObject *obj;
+	unsigned char high = HIGH, low = LOW;
+	image_view image;
+	uint8_t *classes;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|bb", (char**) keywords, &obj, &high, &low)
+			|| !getImage(obj, image, "image", false))
+		return NULL;
+	PyObject *result = newImage(image.width, image.height, classes);
+	if (!result)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	std::unique_ptr<threshold_state> s(new threshold_state());
+	perf_counters perf;
+	runStage<grey_data, grey_data>(image.width, image.height,
+			[&](int x, int y) {
+				uint8_t value = (y == THRES_ROW && x < 2) ? (x ? low : high) : image.at(x, y);
+				return beat<grey_data>(value, x, y, image.width); },
+			[&](grey_stream &src, grey_stream &dst) { threshold_stage(*s, src, dst, perf); },
+			[&](const grey_data &p, size_t i) { classes[i] = p.data; });
+	Py_END_ALLOW_THREADS
+
+	return result;
+}
+
+
+/* The exact hysteresis outputs a frame late, so it gets the frame twice
+ */
+static PyObject *py_hysteresis(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"image", "hyst_mode", NULL};
+	PyObject *obj;
+	unsigned char hyst_mode = HYST_WINDOW;
+	image_view image;
+	uint8_t *edges;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|b", (char**) keywords, &obj, &hyst_mode)
+			|| !getImage(obj, image, "image", false))
+		return NULL;
+	PyObject *result = newImage(image.width, image.height, edges);
+	if (!result)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	std::unique_ptr<hysteresis_state> s(new hysteresis_state());
+	perf_counters perf;
+	for (int frame = 0; frame < 1 + (hyst_mode == HYST_EXACT); frame++)
+		runStage<grey_data, pixel_data>(image.width, image.height,
+				[&](int x, int y) { return beat<grey_data>(image.at(x, y), x, y, image.width); },
+				[&](grey_stream &src, pixel_stream &dst) {
+					hysteresis_stage(*s, src, dst, image.width, image.height, hyst_mode, perf); },
+				[&](const pixel_data &p, size_t i) { edges[i] = p.data & 0xFF; });
+	Py_END_ALLOW_THREADS
+
+	return result;
+}
+
+
+/* Packed RGBA words of an image, in place when it is a C-contiguous (H, W, 4)
+ * array, whose pixels are the words on a little-endian host. Alpha is not
+ * read by the chain. Other layouts are packed into words.
+ */
+static const uint32_t *rgbaWords(const image_view &image, std::vector<uint32_t> &words)
+{
+	const Py_buffer &v = image.view;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	if (image.channels == 4 && v.strides[2] == 1 && v.strides[1] == 4 && v.strides[0] == 4 * (Py_ssize_t) image.width
+			&& (uintptr_t) v.buf % alignof(uint32_t) == 0)
+		return (const uint32_t*) v.buf;
+#endif
+
+	words.resize((size_t) image.width * image.height);
+	for (int y = 0; y < image.height; y++)
+		for (int x = 0; x < image.width; x++)
+			words[(size_t) y * image.width + x] = rgbaWord(image, x, y);
+	return words.data();
+}
+
+
+/* The chain on the row-band engine. The image is repeated until the edges
+ * settle, a frame more for the thresholds from its histogram and one more
+ * for the exact hysteresis.
+ */
+static PyObject *py_canny(PyObject *, PyObject *args, PyObject *kwargs)
+{
+	static const char *keywords[] = {"image", "mask", "thres_mode", "hyst_mode", "high", "low", "threads", NULL};
+	PyObject *obj;
+	unsigned int mask = 1;
+	unsigned char thres_mode = THRES_FIXED, hyst_mode = HYST_WINDOW, high = 0, low = 0;
+	int threads = 0;
+	image_view image;
+	uint8_t *edges;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|Ibbbbi", (char**) keywords, &obj, &mask, &thres_mode,
+			&hyst_mode, &high, &low, &threads) || !getImage(obj, image, "image", false))
+		return NULL;
+	PyObject *result = newImage(image.width, image.height, edges);
+	if (!result)
+		return NULL;
+
+	Py_BEGIN_ALLOW_THREADS
+	std::vector<uint32_t> words;
+	std::vector<uint8_t> out;
+	const uint32_t *rgba = rgbaWords(image, words);
+
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	band_engine engine(threads, mask, thres_mode, high, low, hyst_mode);
+	for (int frame = 0; frame < 1 + (thres_mode != THRES_FIXED) + (hyst_mode == HYST_EXACT); frame++)
+		engine.process(rgba, out, image.width, image.height);
+	std::copy(out.begin(), out.end(), edges);
+	Py_END_ALLOW_THREADS
+
+	return result;
+}
+
+
+// The keyword functions go through a void function pointer, the cast Python
+// documents for METH_KEYWORDS entries
+static PyMethodDef canny_methods[] = {
+	{"greyscale", (PyCFunction)(void(*)(void)) py_greyscale, METH_VARARGS | METH_KEYWORDS,
+		"greyscale(image) -> grey\n\nShift-add luma of an (H, W, 3) RGB or (H, W, 4) RGBA image."},
+	{"gauss", (PyCFunction)(void(*)(void)) py_gauss, METH_VARARGS | METH_KEYWORDS,
+		"gauss(image) -> blur\n\n5x5 Gaussian of channel 0, lagging 2 rows and columns."},
+	{"sobel", (PyCFunction)(void(*)(void)) py_sobel, METH_VARARGS | METH_KEYWORDS,
+		"sobel(image, mask=1) -> (magnitude, direction)\n\nGradient magnitude and suppression sector 0-3 of the "
+		"Sobel variant mask, lagging 1 row and column. magnitude[4, 0] and magnitude[4, 1] carry HIGH and LOW "
+		"to threshold."},
+	{"suppression", (PyCFunction)(void(*)(void)) py_suppression, METH_VARARGS | METH_KEYWORDS,
+		"suppression(magnitude, direction) -> thin\n\nNon-maximum suppression, lagging 1 row and column."},
+	{"threshold", (PyCFunction)(void(*)(void)) py_threshold, METH_VARARGS | METH_KEYWORDS,
+		"threshold(image, high=HIGH, low=LOW) -> classes\n\nSTRONG, WEAK or 0 per pixel. high and low go in "
+		"as image[4, 0] and image[4, 1], like from sobel."},
+	{"hysteresis", (PyCFunction)(void(*)(void)) py_hysteresis, METH_VARARGS | METH_KEYWORDS,
+		"hysteresis(image, hyst_mode=0) -> edges\n\n3x3 window, lagging 1 row and column, or exact edge tracking "
+		"with hyst_mode=1."},
+	{"canny", (PyCFunction)(void(*)(void)) py_canny, METH_VARARGS | METH_KEYWORDS,
+		"canny(image, mask=1, thres_mode=0, hyst_mode=0, high=0, low=0, threads=0) -> edges\n\nThe whole chain on "
+		"the row-band engine, bit-exact with the stages. Like the stream, the edges lag the input by 5 rows and "
+		"columns: edges[y, x] belongs to pixel (y-5, x-5), and the first 5 rows and columns are 0. Nonzero high "
+		"and low override the thresholds, threads=0 runs a thread per core. Contiguous (H, W, 4) images are read "
+		"in place."},
+	{NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef canny_module = {
+	PyModuleDef_HEAD_INIT, "canny_native", "Canny edge detection stages of the FPGA overlay, run natively", -1,
+	canny_methods, NULL, NULL, NULL, NULL
+};
+
+
+PyMODINIT_FUNC PyInit_canny_native(void)
+{
+	PyObject *module = PyModule_Create(&canny_module);
+	if (!module)
+		return NULL;
+
+	PyModule_AddIntConstant(module, "HIGH", HIGH);
+	PyModule_AddIntConstant(module, "LOW", LOW);
+	PyModule_AddIntConstant(module, "WEAK", WEAK);
+	PyModule_AddIntConstant(module, "STRONG", STRONG);
+	PyModule_AddIntConstant(module, "MAX_WIDTH", MAX_WIDTH);
+	PyModule_AddIntConstant(module, "MAX_HEIGHT", MAX_HEIGHT);
+	return module;
+}
@@ -0,0 +1,437 @@
+/* Accuracy against speed of the Sobel variants
+ *
+ * Runs every mask of the sobel stage over an image corpus and scores the
+ * edges against a port of the floating point reference in
+ * python_implementation/project_python.ipynb, with precision, recall and
+ * F1 of the edge pixels and the PSNR of the edge map. Next to the scores
+ * it records the time per pixel of the C model and the estimated latency
+ * of the chain, and marks the configurations on the Pareto front of F1
+ * against latency.
+ *
+ * The CORDIC iterations are fixed at build time, canny_sweep_cordicN is the
+ * same harness on a chain built with N iterations. With -o every build
+ * appends its rows to the same file and the front is taken over all of them.
+ *
+ * usage: canny_sweep [-r repeats] [-d distance] [-o results.csv] [input.ppm ...]
+ * -d is the distance in pixels within which an edge counts as found, 1 by
+ * default. Without images the synthetic 720p frame is scored.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "canny.h"
+#include "frame_io.h"
+
+// Rows and columns the chain output lags its input: two for the Gaussian
+// and one each for sobel, suppression and the hysteresis window
+#define CHAIN_DELAY 5
+
+// Estimated latency in cycles of the stages other than sobel, and of sobel
+// with hls::sqrt and hls::atan2, from the synthesis reports in the notebook
+#define OTHER_LATENCY (2 + 21 + 3 + 2 + 3)
+#define SQRT_ATAN2_LATENCY 93
+
+
+// Image of the corpus with its reference edges
+struct sweep_image {
+	std::string name;
+	std::vector<uint32_t> rgba;
+	std::vector<uint8_t> reference;
+	int width, height;
+};
+
+// Sobel variant under test
+struct sweep_variant {
+	uint32_t mask;
+	std::string name;
+	int latency;
+};
+
+// Scores of a variant, averaged over the corpus
+struct sweep_result {
+	std::string name;
+	uint32_t mask;
+	int iterations;
+	double precision, recall, f1, psnr, ns;
+	int latency;
+};
+
+
+/* Sobel variants of this build. The CORDIC takes a cycle per iteration
+ * after the two of the convolution, the square root an estimated cycle per
+ * result bit, |Gx|+|Gy| an adder and alpha max plus beta min a compare
+ * ahead of its adders.
+ */
+static std::vector<sweep_variant> sweepVariants()
+{
+	std::vector<sweep_variant> variants;
+
+	variants.push_back({0, "sqrt+atan2", SQRT_ATAN2_LATENCY});
+	variants.push_back({1, "cordic" + std::to_string(CORDIC_ITERATIONS), 2 + CORDIC_ITERATIONS});
+	variants.push_back({2, "sqrt+sector", 2 + 16 + 1});
+	variants.push_back({3, "l1+sector", 2 + 1 + 1});
+	variants.push_back({4, "maxmin+sector", 2 + 2 + 1});
+	return variants;
+}
+
+
+static int reflect(int i, int n)
+{
+	if (i < 0)
+		return -i - 1;
+	if (i >= n)
+		return 2 * n - i - 1;
+	return i;
+}
+
+
+/* Edges of the Python reference: luma, 5x5 Gaussian and Sobel in floating
+ * point with reflected borders, the magnitude scaled to a maximum of 255,
+ * suppression over the 4 sectors of the angle, HIGH and LOW and a single
+ * raster pass of the hysteresis in place. The notebook blurs the red
+ * channel, here the luma as in the rest of the chain.
+ */
+static void referenceEdges(const std::vector<uint32_t> &rgba, std::vector<uint8_t> &edges, int width, int height)
+{
+	static const int gauss[5][5] = {{1,4,7,4,1},{4,16,26,16,4},{7,26,41,26,7},{4,16,26,16,4},{1,4,7,4,1}};
+	size_t pixels = (size_t)width * height;
+	std::vector<float> grey(pixels), blur(pixels), magnitude(pixels), angle(pixels);
+	std::vector<int> scaled(pixels), suppressed(pixels, 0);
+	float peak = 0;
+
+	for (size_t i = 0; i < pixels; i++)
+	{
+		uint32_t d = rgba[i];
+		grey[i] = (uint8_t)(0.299f * (d & 0xFF) + 0.587f * ((d >> 8) & 0xFF) + 0.114f * ((d >> 16) & 0xFF) + 0.5f);
+	}
+
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			float sum = 0;
+			for (int i = -2; i < 3; i++)
+				for (int j = -2; j < 3; j++)
+					sum += gauss[i+2][j+2] * grey[(size_t)reflect(y + i, height) * width + reflect(x + j, width)];
+			blur[(size_t)y * width + x] = (uint8_t)(sum / 273);
+		}
+
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			float w[3][3];
+			for (int i = -1; i < 2; i++)
+				for (int j = -1; j < 2; j++)
+					w[i+1][j+1] = blur[(size_t)reflect(y + i, height) * width + reflect(x + j, width)];
+
+			float i_x = (w[0][2] + 2 * w[1][2] + w[2][2]) - (w[0][0] + 2 * w[1][0] + w[2][0]);
+			float i_y = (w[0][0] + 2 * w[0][1] + w[0][2]) - (w[2][0] + 2 * w[2][1] + w[2][2]);
+			size_t i = (size_t)y * width + x;
+			magnitude[i] = sqrtf(i_x * i_x + i_y * i_y);
+			angle[i] = atan2f(i_y, i_x) * 180 / M_PI;
+			if (angle[i] < 0)
+				angle[i] += 180;
+			peak = std::max(peak, magnitude[i]);
+		}
+
+	for (size_t i = 0; i < pixels; i++)
+		scaled[i] = peak > 0 ? (int)(magnitude[i] / peak * 255) : 0;
+
+	for (int y = 1; y < height - 1; y++)
+		for (int x = 1; x < width - 1; x++)
+		{
+			size_t i = (size_t)y * width + x;
+			float a = angle[i];
+			int q, r;
+			if (a < 22.5 || a >= 157.5)
+			{
+				q = scaled[i + 1];
+				r = scaled[i - 1];
+			}
+			else if (a < 67.5)
+			{
+				q = scaled[i + width - 1];
+				r = scaled[i - width + 1];
+			}
+			else if (a < 112.5)
+			{
+				q = scaled[i + width];
+				r = scaled[i - width];
+			}
+			else
+			{
+				q = scaled[i - width - 1];
+				r = scaled[i + width + 1];
+			}
+			suppressed[i] = (scaled[i] >= q && scaled[i] >= r) ? scaled[i] : 0;
+		}
+
+	// the notebook assigns weak after strong, a magnitude of HIGH is weak
+	std::vector<uint8_t> thres(pixels);
+	for (size_t i = 0; i < pixels; i++)
+		thres[i] = suppressed[i] > HIGH ? STRONG : (suppressed[i] >= LOW ? WEAK : 0);
+
+	for (int y = 1; y < height - 1; y++)
+		for (int x = 1; x < width - 1; x++)
+		{
+			size_t i = (size_t)y * width + x;
+			if (thres[i] != WEAK)
+				continue;
+			bool strong = false;
+			for (int a = -1; a < 2; a++)
+				for (int b = -1; b < 2; b++)
+					if ((a || b) && thres[i + a * width + b] == STRONG)
+						strong = true;
+			thres[i] = strong ? STRONG : 0;
+		}
+
+	edges.resize(pixels);
+	for (size_t i = 0; i < pixels; i++)
+		edges[i] = (thres[i] == STRONG) ? 255 : 0;
+}
+
+
+/* Run a frame through the chain from reset, fixed thresholds on the scale
+ * of the mask and the hysteresis window, the best time of the repeats
+ */
+static double chainEdges(const sweep_image &image, uint32_t mask, std::vector<uint8_t> &edges, int repeats)
+{
+	double best = 0;
+	uint8_t high = HIGH, low = LOW;
+	uint16_t thresholds;
+	std::unique_ptr<magnitude_hist<1>> hist(new magnitude_hist<1>());
+
+	frame_thresholds(*hist, mask, THRES_FIXED, 0, 0, image.width, high, low, thresholds);
+
+	edges.resize(image.rgba.size());
+	for (int r = 0; r < repeats; r++)
+	{
+		std::unique_ptr<span_state> s(new span_state());
+		auto start = std::chrono::steady_clock::now();
+		for (int y = 0; y < image.height; y++)
+			canny_row(*s, &image.rgba[(size_t)y * image.width], &edges[(size_t)y * image.width], y,
+					image.width, image.height, mask, high, low, HYST_WINDOW, 0);
+		auto stop = std::chrono::steady_clock::now();
+		double sec = std::chrono::duration<double>(stop - start).count();
+		if (r == 0 || sec < best)
+			best = sec;
+	}
+
+	return best;
+}
+
+
+/* Edge pixel within distance of an edge of the other map
+ */
+static bool near(const std::vector<uint8_t> &map, int offset, int x, int y, int width, int height, int distance)
+{
+	for (int i = -distance; i <= distance; i++)
+		for (int j = -distance; j <= distance; j++)
+		{
+			int u = x + j, v = y + i;
+			if (u >= 0 && v >= 0 && u < width - offset && v < height - offset
+					&& map[(size_t)(v + offset) * width + u + offset])
+				return true;
+		}
+	return false;
+}
+
+
+/* Precision, recall and F1 of the edges against the reference, and the
+ * PSNR of the edge map. Edge (x,y) of the chain is reference pixel
+ * (x-CHAIN_DELAY, y-CHAIN_DELAY).
+ */
+static void score(const sweep_image &image, const std::vector<uint8_t> &edges, int distance,
+		double &precision, double &recall, double &f1, double &psnr)
+{
+	int width = image.width, height = image.height;
+	size_t found = 0, detected = 0, matched = 0, expected = 0;
+	double error = 0;
+
+	for (int y = 0; y < height - CHAIN_DELAY; y++)
+		for (int x = 0; x < width - CHAIN_DELAY; x++)
+		{
+			uint8_t e = edges[(size_t)(y + CHAIN_DELAY) * width + x + CHAIN_DELAY];
+			uint8_t r = image.reference[(size_t)y * width + x];
+			double d = (double)e - r;
+			error += d * d;
+
+			if (e)
+			{
+				detected++;
+				found += near(image.reference, 0, x, y, width, height, distance);
+			}
+			if (r)
+			{
+				expected++;
+				matched += near(edges, CHAIN_DELAY, x, y, width, height, distance);
+			}
+		}
+
+	precision = detected ? (double)found / detected : 1;
+	recall = expected ? (double)matched / expected : 1;
+	f1 = (precision + recall > 0) ? 2 * precision * recall / (precision + recall) : 0;
+
+	double mse = error / ((double)(width - CHAIN_DELAY) * (height - CHAIN_DELAY));
+	psnr = (mse > 0) ? 10 * log10(255.0 * 255.0 / mse) : 99.99;
+}
+
+
+static void printResult(const sweep_result &r, bool pareto)
+{
+	printf("%-14s %4u %5d %9.4f %9.4f %9.4f %9.2f %9.2f %7d %s\n", r.name.c_str(), r.mask, r.iterations,
+			r.precision, r.recall, r.f1, r.psnr, r.ns, r.latency, pareto ? "*" : "");
+}
+
+
+/* Append the results to the CSV file, then read back every row in it, the
+ * last row of a variant replacing earlier ones
+ */
+static bool mergeResults(const std::string &filename, std::vector<sweep_result> &results)
+{
+	{
+		std::ifstream probe(filename.c_str());
+		bool header = !probe.good() || probe.peek() == std::ifstream::traits_type::eof();
+		std::ofstream csv(filename.c_str(), std::ios::app);
+		if (!csv)
+			return false;
+		if (header)
+			csv << "variant,mask,iterations,precision,recall,f1,psnr,ns_per_pixel,latency\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const sweep_result &r = results[i];
+			csv << r.name << "," << r.mask << "," << r.iterations << "," << r.precision << "," << r.recall << ","
+					<< r.f1 << "," << r.psnr << "," << r.ns << "," << r.latency << "\n";
+		}
+	}
+
+	std::ifstream csv(filename.c_str());
+	std::string line;
+	std::vector<sweep_result> merged;
+	std::getline(csv, line);
+	while (std::getline(csv, line))
+	{
+		sweep_result r;
+		std::string name;
+		std::istringstream fields(line);
+		char comma;
+		if (!std::getline(fields, name, ',') || !(fields >> r.mask >> comma >> r.iterations >> comma >> r.precision
+				>> comma >> r.recall >> comma >> r.f1 >> comma >> r.psnr >> comma >> r.ns >> comma >> r.latency))
+			continue;
+		r.name = name;
+
+		size_t k = 0;
+		while (k < merged.size() && merged[k].name != r.name)
+			k++;
+		if (k == merged.size())
+			merged.push_back(r);
+		else
+			merged[k] = r;
+	}
+
+	results = merged;
+	return true;
+}
+
+
+int main(int argc, char **argv)
+{
+	int repeats = 3;
+	int distance = 1;
+	std::string output;
+	std::vector<sweep_image> images;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-r") && i + 1 < argc)
+			repeats = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i + 1 < argc)
+			distance = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			output = argv[++i];
+		else
+		{
+			sweep_image image;
+			image.name = argv[i];
+			if (!readPPM(argv[i], image.rgba, image.width, image.height))
+			{
+				std::cout << "##### Invalid input image " << argv[i] << " #####" << std::endl;
+				return 1;
+			}
+			if (image.width > MAX_WIDTH || image.height > MAX_HEIGHT)
+			{
+				std::cout << "##### " << argv[i] << " exceeds " << MAX_WIDTH << "x" << MAX_HEIGHT << " #####" << std::endl;
+				return 1;
+			}
+			images.push_back(image);
+		}
+	}
+
+	if (images.empty())
+	{
+		sweep_image image;
+		image.name = "1280x720";
+		image.width = 1280;
+		image.height = 720;
+		synthFrame(image.rgba, image.width, image.height);
+		images.push_back(image);
+	}
+
+	for (size_t i = 0; i < images.size(); i++)
+		referenceEdges(images[i].rgba, images[i].reference, images[i].width, images[i].height);
+
+	std::vector<sweep_variant> variants = sweepVariants();
+	std::vector<sweep_result> results;
+	std::vector<uint8_t> edges;
+
+	printf("%d images, %d CORDIC iterations, distance %d\n", (int)images.size(), CORDIC_ITERATIONS, distance);
+	for (size_t v = 0; v < variants.size(); v++)
+	{
+		sweep_result r = {variants[v].name, variants[v].mask, CORDIC_ITERATIONS, 0, 0, 0, 0, 0,
+				OTHER_LATENCY + variants[v].latency};
+		double pixels = 0, sec = 0;
+
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			double precision, recall, f1, psnr;
+			sec += chainEdges(images[i], variants[v].mask, edges, repeats);
+			pixels += (double)images[i].width * images[i].height;
+			score(images[i], edges, distance, precision, recall, f1, psnr);
+			r.precision += precision / images.size();
+			r.recall += recall / images.size();
+			r.f1 += f1 / images.size();
+			r.psnr += psnr / images.size();
+		}
+		r.ns = sec * 1e9 / pixels;
+		results.push_back(r);
+	}
+
+	if (!output.empty() && !mergeResults(output, results))
+	{
+		std::cout << "##### Could not write " << output << " #####" << std::endl;
+		return 1;
+	}
+
+	// on the front when no other variant is at least as accurate and fast
+	printf("%-14s %4s %5s %9s %9s %9s %9s %9s %7s\n", "variant", "mask", "iter", "precision", "recall", "F1",
+			"PSNR dB", "ns/pixel", "cycles");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		bool pareto = true;
+		for (size_t k = 0; k < results.size(); k++)
+			if (k != i && results[k].f1 >= results[i].f1 && results[k].latency <= results[i].latency
+					&& (results[k].f1 > results[i].f1 || results[k].latency < results[i].latency))
+				pareto = false;
+		printResult(results[i], pareto);
+	}
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+/* The 32-bit or the 8-bit top of every stage, picked by stream type, so
+ * the host drivers can run either stream format through one template
+ */
+
+#ifndef CANNY_TOPS_H
+#define CANNY_TOPS_H
+
+#include "canny.h"
+
+inline void greyscale_any(pixel_stream &src, pixel_stream &dst, perf_counters &perf)
+{
+	greyscale(src, dst, perf);
+}
+inline void greyscale_any(pixel_stream &src, grey_stream &dst, perf_counters &perf)
+{
+	greyscale8(src, dst, perf);
+}
+
+inline void gauss_any(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters &perf)
+{
+	gauss(src, dst, width, height, perf);
+}
+inline void gauss_any(grey_stream &src, grey_stream &dst, uint16_t width, uint16_t height, perf_counters &perf)
+{
+	gauss8(src, dst, width, height, perf);
+}
+
+inline void sobel_any(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds,
+		perf_counters &perf)
+{
+	sobel(src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+inline void sobel_any(grey_stream &src, grey_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds,
+		perf_counters &perf)
+{
+	sobel8(src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+inline void front_any(pixel_stream &src, pixel_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds,
+		perf_counters &perf)
+{
+	front(src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+inline void front_any(pixel_stream &src, grey_stream &dst, uint32_t mask, uint16_t width, uint16_t height,
+		uint8_t thres_mode, uint8_t high_set, uint8_t low_set, uint16_t& thresholds,
+		perf_counters &perf)
+{
+	front8(src, dst, mask, width, height, thres_mode, high_set, low_set, thresholds, perf);
+}
+
+inline void suppression_any(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, perf_counters &perf)
+{
+	suppression(src, dst, width, height, perf);
+}
+inline void suppression_any(grey_stream &src, grey_stream &dst, uint16_t width, uint16_t height, perf_counters &perf)
+{
+	suppression8(src, dst, width, height, perf);
+}
+
+inline void threshold_any(pixel_stream &src, pixel_stream &dst, perf_counters &perf)
+{
+	threshold(src, dst, perf);
+}
+inline void threshold_any(grey_stream &src, grey_stream &dst, perf_counters &perf)
+{
+	threshold8(src, dst, perf);
+}
+
+inline void hysteresis_any(pixel_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, uint8_t hyst_mode,
+		perf_counters &perf)
+{
+#if HYST_EXACT_ENABLE
+	if (hyst_mode == HYST_EXACT)
+	{
+		hysteresis_exact(src, dst, width, height, perf);
+		return;
+	}
+#endif
+	hysteresis(src, dst, width, height, perf);
+}
+inline void hysteresis_any(grey_stream &src, pixel_stream &dst, uint16_t width, uint16_t height, uint8_t hyst_mode,
+		perf_counters &perf)
+{
+#if HYST_EXACT_ENABLE
+	if (hyst_mode == HYST_EXACT)
+	{
+		hysteresis_exact8(src, dst, width, height, perf);
+		return;
+	}
+#endif
+	hysteresis8(src, dst, width, height, perf);
+}
+
+#endif // CANNY_TOPS_H
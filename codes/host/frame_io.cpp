@@ -0,0 +1,70 @@
+/* Image I/O of the host drivers
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "frame_io.h"
+
+
+/* Read binary PPM (P6) into packed RGBA words
+ *
+ * filename - path to input image
+ * rgba     - output pixels, red in the lowest byte like CV_BGR2RGBA
+ */
+bool readPPM(const std::string &filename, std::vector<uint32_t> &rgba, int &width, int &height)
+{
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	int maxval;
+	char magic[3] = {0};
+	if (fscanf(f, "%2s %d %d %d", magic, &width, &height, &maxval) != 4 || strcmp(magic, "P6") || maxval != 255)
+	{
+		fclose(f);
+		return false;
+	}
+	fgetc(f);
+
+	std::vector<uint8_t> rgb((size_t)width * height * 3);
+	bool ok = fread(rgb.data(), 1, rgb.size(), f) == rgb.size();
+	fclose(f);
+
+	rgba.resize((size_t)width * height);
+	for (size_t i = 0; i < rgba.size(); i++)
+		rgba[i] = 0xFF000000 | (rgb[3*i+2] << 16) | (rgb[3*i+1] << 8) | rgb[3*i];
+
+	return ok;
+}
+
+
+/* Write the first channel of a frame as binary PGM (P5)
+ */
+bool writePGM(const std::string &filename, const std::vector<uint8_t> &grey, int width, int height)
+{
+	FILE *f = fopen(filename.c_str(), "wb");
+	if (f == NULL)
+		return false;
+
+	fprintf(f, "P5\n%d %d\n255\n", width, height);
+	bool ok = fwrite(grey.data(), 1, grey.size(), f) == grey.size();
+	fclose(f);
+
+	return ok;
+}
+
+
+/* Synthetic test frame: smooth gradients with a few hard edges
+ */
+void synthFrame(std::vector<uint32_t> &rgba, int width, int height)
+{
+	rgba.resize((size_t)width * height);
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			uint8_t r = (uint8_t)(x * 255 / width);
+			uint8_t g = (uint8_t)(y * 255 / height);
+			uint8_t b = ((x / 64 + y / 64) & 1) ? 220 : 30;
+			rgba[(size_t)y * width + x] = 0xFF000000 | (b << 16) | (g << 8) | r;
+		}
+}
@@ -0,0 +1,15 @@
+/* Image I/O of the host drivers
+ */
+
+#ifndef FRAME_IO_H
+#define FRAME_IO_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+bool readPPM(const std::string &filename, std::vector<uint32_t> &rgba, int &width, int &height);
+bool writePGM(const std::string &filename, const std::vector<uint8_t> &grey, int width, int height);
+void synthFrame(std::vector<uint32_t> &rgba, int width, int height);
+
+#endif // FRAME_IO_H
@@ -0,0 +1,55 @@
+/* Host stand-in for the Vivado HLS math library
+ *
+ * Integer sqrt returns the floor of the exact root, as the synthesized
+ * integer square root does. atan2 on integer operands is evaluated in
+ * single precision like the C-simulation model.
+ */
+
+#ifndef HOST_HLS_MATH_H
+#define HOST_HLS_MATH_H
+
+#include <stdint.h>
+#include <math.h>
+
+namespace hls {
+
+inline uint32_t sqrt(uint32_t x){
+	uint32_t r = (uint32_t) ::sqrt((double) x);
+	while ((uint64_t) r * r > x)
+		r--;
+	while ((uint64_t) (r + 1) * (r + 1) <= x)
+		r++;
+	return r;
+}
+
+inline int32_t sqrt(int32_t x){
+	return x <= 0 ? 0 : (int32_t) sqrt((uint32_t) x);
+}
+
+inline float sqrt(float x){
+	return ::sqrtf(x);
+}
+
+inline double sqrt(double x){
+	return ::sqrt(x);
+}
+
+inline float atan2(float y, float x){
+	return ::atan2f(y, x);
+}
+
+inline double atan2(double y, double x){
+	return ::atan2(y, x);
+}
+
+inline float atan2(int16_t y, int16_t x){
+	return ::atan2f((float) y, (float) x);
+}
+
+inline float atan2(int32_t y, int32_t x){
+	return ::atan2f((float) y, (float) x);
+}
+
+} // namespace hls
+
+#endif // HOST_HLS_MATH_H
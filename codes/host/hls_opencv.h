@@ -0,0 +1,52 @@
+/* Host stand-in for the Vivado HLS OpenCV interface
+ *
+ * Converts between 8-bit, 4 channel cv::Mat images and AXI4-Stream video
+ * with the start of frame on TUSER and the end of line on TLAST.
+ */
+
+#ifndef HOST_HLS_OPENCV_H
+#define HOST_HLS_OPENCV_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgproc/types_c.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include "hls_stream.h"
+#include "ap_axi_sdata.h"
+
+template<int W, int U, int TI, int TD>
+void cvMat2AXIvideo(cv::Mat &img, hls::stream<ap_axiu<W,U,TI,TD> > &stream)
+{
+	ap_axiu<W,U,TI,TD> p;
+
+	for (int y = 0; y < img.rows; y++)
+		for (int x = 0; x < img.cols; x++)
+		{
+			cv::Vec4b v = img.at<cv::Vec4b>(y, x);
+			p.data = v[0] | (v[1] << 8) | (v[2] << 16) | ((uint32_t) v[3] << 24);
+			p.keep = -1;
+			p.strb = -1;
+			p.user = (x == 0 && y == 0);
+			p.last = (x == img.cols - 1);
+			p.id = 0;
+			p.dest = 0;
+			stream << p;
+		}
+}
+
+template<int W, int U, int TI, int TD>
+void AXIvideo2cvMat(hls::stream<ap_axiu<W,U,TI,TD> > &stream, cv::Mat &img)
+{
+	ap_axiu<W,U,TI,TD> p;
+
+	for (int y = 0; y < img.rows; y++)
+		for (int x = 0; x < img.cols; x++)
+		{
+			stream >> p;
+			uint32_t d = p.data;
+			img.at<cv::Vec4b>(y, x) = cv::Vec4b(d, d >> 8, d >> 16, d >> 24);
+		}
+}
+
+#endif // HOST_HLS_OPENCV_H
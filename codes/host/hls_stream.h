@@ -0,0 +1,115 @@
+/* Host stand-in for the Vivado HLS stream channel
+ *
+ * Behaves like the C-simulation model: an unbounded FIFO, reading from an
+ * empty stream warns and returns a default constructed value. Storage is a
+ * ring that only grows, so a stream in steady state never allocates.
+ *
+ * After set_depth() the ring is bounded and lock-free between one producer
+ * and one consumer thread: reads wait while the stream is empty and writes
+ * while it is full, like the FIFO between two dataflow processes.
+ */
+
+#ifndef HOST_HLS_STREAM_H
+#define HOST_HLS_STREAM_H
+
+#include <stddef.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include <iostream>
+
+namespace hls {
+
+template<typename T>
+class stream {
+public:
+	stream() : name("hls::stream"), fifo(16), mask(15), depth(0), head(0), tail(0) {}
+	explicit stream(const char *n) : name(n), fifo(16), mask(15), depth(0), head(0), tail(0) {}
+
+	bool empty() const { return size() == 0; }
+	bool full() const { return depth && size() >= depth; }
+	size_t size() const { return depth ? load(tail) - load(head) : tail - head; }
+
+	// Bound the stream to n entries, a power of two, before any thread uses it
+	void set_depth(size_t n) {
+		fifo.assign(n, T());
+		mask = n - 1;
+		depth = n;
+		head = 0;
+		tail = 0;
+	}
+
+	void write(const T &v) {
+		if (depth)
+			while (full())
+				std::this_thread::yield();
+		else if (tail - head == fifo.size())
+			grow();
+		fifo[tail & mask] = v;
+		store(tail, tail + 1);
+	}
+
+	T read() {
+		while (empty()) {
+			if (!depth) {
+				std::cerr << "WARNING: Hls::stream '" << name << "' is read while empty" << std::endl;
+				return T();
+			}
+			std::this_thread::yield();
+		}
+		T v = fifo[head & mask];
+		store(head, head + 1);
+		return v;
+	}
+
+	bool read_nb(T &v) {
+		if (empty())
+			return false;
+		v = read();
+		return true;
+	}
+
+	bool write_nb(const T &v) {
+		if (full())
+			return false;
+		write(v);
+		return true;
+	}
+
+	void operator>>(T &v) { v = read(); }
+	void operator<<(const T &v) { write(v); }
+
+private:
+	stream(const stream &);
+	stream& operator=(const stream &);
+
+	// Indices of a bounded stream are shared between its producer and its
+	// consumer thread, each of them only writes its own
+	size_t load(const size_t &i) const { return __atomic_load_n(&i, __ATOMIC_ACQUIRE); }
+	void store(size_t &i, size_t v) {
+		if (depth)
+			__atomic_store_n(&i, v, __ATOMIC_RELEASE);
+		else
+			i = v;
+	}
+
+	void grow() {
+		std::vector<T> next(fifo.size() * 2);
+		for (size_t i = head; i != tail; i++)
+			next[i - head] = fifo[i & mask];
+		tail -= head;
+		head = 0;
+		fifo.swap(next);
+		mask = fifo.size() - 1;
+	}
+
+	std::string name;
+	std::vector<T> fifo;
+	size_t mask, depth;
+	alignas(64) size_t head;
+	alignas(64) size_t tail;
+};
+
+} // namespace hls
+
+#endif // HOST_HLS_STREAM_H
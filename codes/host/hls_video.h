@@ -0,0 +1,12 @@
+/* Host stand-in for the Vivado HLS video library
+ *
+ * The Canny stages keep their own line buffers, so only the math
+ * functions they use from this header are provided.
+ */
+
+#ifndef HOST_HLS_VIDEO_H
+#define HOST_HLS_VIDEO_H
+
+#include "hls_math.h"
+
+#endif // HOST_HLS_VIDEO_H
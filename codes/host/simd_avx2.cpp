@@ -0,0 +1,80 @@
+/* AVX2 row kernels, 16 pixels of 16-bit lanes per instruction
+ */
+
+#include <string.h>
+#include <immintrin.h>
+#include "canny.h"
+#include "simd_rows.h"
+
+// Only the kernels below are built for AVX2, the inline functions of the
+// headers above keep the baseline instruction set for the rest of the build
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+struct avx2_lanes {
+	typedef __m256i vec;
+	typedef __m256i mask;
+	enum { N = 16 };
+
+	static vec load(const uint8_t *p) { return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*) p)); }
+	static void store(uint8_t *p, vec v) {
+		__m256i b = _mm256_packus_epi16(v, v);
+		_mm_storeu_si128((__m128i*) p, _mm256_castsi256_si128(_mm256_permute4x64_epi64(b, 0x08)));
+	}
+	static void store16(int16_t *p, vec v) { _mm256_storeu_si256((__m256i*) p, v); }
+
+	// Greyscale of 16 RGBA words, the weighted sum fits in a byte
+	static vec grey(const uint32_t *p) {
+		__m256i g[2];
+		const __m256i byte = _mm256_set1_epi32(0xFF);
+		for (int i = 0; i < 2; i++) {
+			__m256i w = _mm256_loadu_si256((const __m256i*) (p + 8 * i));
+			__m256i r = _mm256_and_si256(w, byte);
+			__m256i gr = _mm256_and_si256(_mm256_srli_epi32(w, 8), byte);
+			__m256i b = _mm256_and_si256(_mm256_srli_epi32(w, 16), byte);
+			g[i] = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_srli_epi32(r, 2), _mm256_srli_epi32(r, 5)),
+					_mm256_add_epi32(_mm256_srli_epi32(b, 4), _mm256_srli_epi32(b, 5))),
+					_mm256_add_epi32(_mm256_srli_epi32(gr, 1), _mm256_srli_epi32(gr, 4)));
+		}
+		return _mm256_permute4x64_epi64(_mm256_packus_epi32(g[0], g[1]), 0xD8);
+	}
+
+	// floor(sqrt(gx^2 + gy^2)) truncated to a byte, exact in single precision
+	// since the sum stays below 2^22
+	static vec magnitude(vec gx, vec gy) {
+		__m256i lo = _mm256_unpacklo_epi16(gx, gy), hi = _mm256_unpackhi_epi16(gx, gy);
+		const __m256i byte = _mm256_set1_epi32(0xFF);
+		lo = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(lo, lo)))), byte);
+		hi = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_sqrt_ps(_mm256_cvtepi32_ps(_mm256_madd_epi16(hi, hi)))), byte);
+		return _mm256_packus_epi32(lo, hi);
+	}
+
+	static vec set(int a) { return _mm256_set1_epi16((short) a); }
+	static vec add(vec a, vec b) { return _mm256_add_epi16(a, b); }
+	static vec sub(vec a, vec b) { return _mm256_sub_epi16(a, b); }
+	static vec mul(vec a, vec b) { return _mm256_mullo_epi16(a, b); }
+	static vec mulhi(vec a, vec b) { return _mm256_mulhi_epu16(a, b); }
+	static vec sll(vec a, int n) { return _mm256_sll_epi16(a, _mm_cvtsi32_si128(n)); }
+	static vec srl(vec a, int n) { return _mm256_srl_epi16(a, _mm_cvtsi32_si128(n)); }
+	static vec sra(vec a, int n) { return _mm256_sra_epi16(a, _mm_cvtsi32_si128(n)); }
+	static vec abs(vec a) { return _mm256_abs_epi16(a); }
+	static vec band(vec a, vec b) { return _mm256_and_si256(a, b); }
+
+	static mask lt(vec a, vec b) { return _mm256_cmpgt_epi16(b, a); }
+	static mask eq(vec a, vec b) { return _mm256_cmpeq_epi16(a, b); }
+	static mask ge_u(vec a, vec b) { return _mm256_cmpeq_epi16(_mm256_max_epu16(a, b), a); }
+	static mask mand(mask a, mask b) { return _mm256_and_si256(a, b); }
+	static mask mor(mask a, mask b) { return _mm256_or_si256(a, b); }
+	static mask mxor(mask a, mask b) { return _mm256_xor_si256(a, b); }
+	static vec select(mask m, vec a, vec b) { return _mm256_blendv_epi8(b, a, m); }
+};
+
+#include "simd_rows_impl.h"
+
+void simd_row_avx2(simd_rows &s, const uint32_t *rgba, uint8_t *out, int y, int width, int height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, bool count)
+{
+	simd_row_impl<avx2_lanes>(s, rgba, out, y, width, height, mask, high, low, hyst_mode, count);
+}
+
+#pragma GCC pop_options
@@ -0,0 +1,78 @@
+/* AVX-512 row kernels, 32 pixels of 16-bit lanes per instruction
+ */
+
+#include <string.h>
+#include <immintrin.h>
+#include "canny.h"
+#include "simd_rows.h"
+
+// Only the kernels below are built for AVX-512, the inline functions of the
+// headers above keep the baseline instruction set for the rest of the build
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+
+struct avx512_lanes {
+	typedef __m512i vec;
+	typedef __mmask32 mask;
+	enum { N = 32 };
+
+	static vec load(const uint8_t *p) { return _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i*) p)); }
+	static void store(uint8_t *p, vec v) { _mm256_storeu_si256((__m256i*) p, _mm512_cvtepi16_epi8(v)); }
+	static void store16(int16_t *p, vec v) { _mm512_storeu_si512(p, v); }
+
+	// Greyscale of 32 RGBA words, the weighted sum fits in a byte
+	static vec grey(const uint32_t *p) {
+		__m256i g[2];
+		const __m512i byte = _mm512_set1_epi32(0xFF);
+		for (int i = 0; i < 2; i++) {
+			__m512i w = _mm512_loadu_si512(p + 16 * i);
+			__m512i r = _mm512_and_si512(w, byte);
+			__m512i gr = _mm512_and_si512(_mm512_srli_epi32(w, 8), byte);
+			__m512i b = _mm512_and_si512(_mm512_srli_epi32(w, 16), byte);
+			g[i] = _mm512_cvtepi32_epi16(_mm512_add_epi32(_mm512_add_epi32(
+					_mm512_add_epi32(_mm512_srli_epi32(r, 2), _mm512_srli_epi32(r, 5)),
+					_mm512_add_epi32(_mm512_srli_epi32(b, 4), _mm512_srli_epi32(b, 5))),
+					_mm512_add_epi32(_mm512_srli_epi32(gr, 1), _mm512_srli_epi32(gr, 4))));
+		}
+		return _mm512_inserti64x4(_mm512_castsi256_si512(g[0]), g[1], 1);
+	}
+
+	// floor(sqrt(gx^2 + gy^2)) truncated to a byte, exact in single precision
+	// since the sum stays below 2^22
+	static vec magnitude(vec gx, vec gy) {
+		__m512i lo = _mm512_unpacklo_epi16(gx, gy), hi = _mm512_unpackhi_epi16(gx, gy);
+		const __m512i byte = _mm512_set1_epi32(0xFF);
+		lo = _mm512_and_si512(_mm512_cvttps_epi32(_mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(lo, lo)))), byte);
+		hi = _mm512_and_si512(_mm512_cvttps_epi32(_mm512_sqrt_ps(_mm512_cvtepi32_ps(_mm512_madd_epi16(hi, hi)))), byte);
+		return _mm512_packus_epi32(lo, hi);
+	}
+
+	static vec set(int a) { return _mm512_set1_epi16((short) a); }
+	static vec add(vec a, vec b) { return _mm512_add_epi16(a, b); }
+	static vec sub(vec a, vec b) { return _mm512_sub_epi16(a, b); }
+	static vec mul(vec a, vec b) { return _mm512_mullo_epi16(a, b); }
+	static vec mulhi(vec a, vec b) { return _mm512_mulhi_epu16(a, b); }
+	static vec sll(vec a, int n) { return _mm512_sll_epi16(a, _mm_cvtsi32_si128(n)); }
+	static vec srl(vec a, int n) { return _mm512_srl_epi16(a, _mm_cvtsi32_si128(n)); }
+	static vec sra(vec a, int n) { return _mm512_sra_epi16(a, _mm_cvtsi32_si128(n)); }
+	static vec abs(vec a) { return _mm512_abs_epi16(a); }
+	static vec band(vec a, vec b) { return _mm512_and_si512(a, b); }
+
+	static mask lt(vec a, vec b) { return _mm512_cmplt_epi16_mask(a, b); }
+	static mask eq(vec a, vec b) { return _mm512_cmpeq_epi16_mask(a, b); }
+	static mask ge_u(vec a, vec b) { return _mm512_cmpge_epu16_mask(a, b); }
+	static mask mand(mask a, mask b) { return a & b; }
+	static mask mor(mask a, mask b) { return a | b; }
+	static mask mxor(mask a, mask b) { return a ^ b; }
+	static vec select(mask m, vec a, vec b) { return _mm512_mask_blend_epi16(m, b, a); }
+};
+
+#include "simd_rows_impl.h"
+
+void simd_row_avx512(simd_rows &s, const uint32_t *rgba, uint8_t *out, int y, int width, int height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, bool count)
+{
+	simd_row_impl<avx512_lanes>(s, rgba, out, y, width, height, mask, high, low, hyst_mode, count);
+}
+
+#pragma GCC pop_options
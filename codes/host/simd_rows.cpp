@@ -0,0 +1,66 @@
+/* Vectorized rows of the Canny chain for the row-band engine
+ */
+
+#include <string.h>
+#include "canny.h"
+#include "simd_rows.h"
+
+
+simd_rows::simd_rows(int width) : grey_k(0), blur_k(0), mag_k(0), thres_k(0)
+{
+	for (int i = 0; i < 5; i++)
+		grey[i].resize(width);
+	for (int i = 0; i < 4; i++)
+	{
+		blur[i].resize(width);
+		mag[i].resize(width);
+		dir[i].resize(width);
+	}
+	for (int i = 0; i < 3; i++)
+		thres[i].resize(width);
+	blur_row.resize(width);
+	mag_row.resize(width);
+	dir_row.resize(width);
+	thres_row.resize(width);
+	grad_x.resize(width);
+	grad_y.resize(width);
+	memset(bins, 0, sizeof(bins));
+}
+
+
+simd_isa simd_detect()
+{
+#ifdef CANNY_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return SIMD_AVX512;
+	if (__builtin_cpu_supports("avx2"))
+		return SIMD_AVX2;
+#endif
+	return SIMD_SCALAR;
+}
+
+
+const char *simd_name(simd_isa isa)
+{
+	const char *names[3] = {"scalar", "avx2", "avx512"};
+	return names[isa];
+}
+
+
+simd_row_fn simd_row(simd_isa isa, int width)
+{
+	// the row kernels implement the default 5x5 Gaussian divided by 273
+	// only and need the column quirks at the line start apart from the tail
+	if (GAUSS_SIZE || width < 16)
+		return NULL;
+#ifdef CANNY_SIMD
+	if (isa == SIMD_AVX512)
+		return simd_row_avx512;
+	if (isa == SIMD_AVX2)
+		return simd_row_avx2;
+#else
+	(void) isa;
+#endif
+	return NULL;
+}
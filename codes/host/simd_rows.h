@@ -0,0 +1,57 @@
+/* Vectorized rows of the Canny chain for the row-band engine
+ *
+ * The same arithmetic as the per-pixel kernels of canny.cpp, a whole row
+ * of a stage at a time on 16-bit lanes: 16 pixels per AVX2 and 32 per
+ * AVX-512 instruction. The line buffers become rings of full rows, pushed
+ * under the same conditions as the stages update their line buffers, so
+ * the rows and columns a window picks up at the frame and line starts are
+ * the ones the stream picks up and the output stays bit-exact.
+ */
+
+#ifndef SIMD_ROWS_H
+#define SIMD_ROWS_H
+
+#include <stdint.h>
+#include <vector>
+
+// Instruction sets of the row kernels, picked at run time
+enum simd_isa {
+	SIMD_SCALAR,
+	SIMD_AVX2,
+	SIMD_AVX512
+};
+
+// Rows of a band, rings indexed by the ring slot of the newest row
+struct simd_rows {
+	explicit simd_rows(int width);
+
+	std::vector<uint8_t> grey[5];	// every row, the 5x5 Gaussian window
+	std::vector<uint8_t> blur[4];	// rows past 1, the Sobel line buffer
+	std::vector<uint8_t> mag[4];	// rows past 2, the suppression line buffer
+	std::vector<uint8_t> dir[4];
+	std::vector<uint8_t> thres[3];	// rows past 3, the hysteresis line buffer
+	int grey_k, blur_k, mag_k, thres_k;
+
+	// rows that are not pushed to a line buffer
+	std::vector<uint8_t> blur_row, mag_row, dir_row, thres_row;
+	std::vector<int16_t> grad_x, grad_y;
+	uint32_t bins[256];
+};
+
+typedef void (*simd_row_fn)(simd_rows &s, const uint32_t *rgba, uint8_t *out, int y, int width, int height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, bool count);
+
+// Widest instruction set the CPU and the build support, SIMD_SCALAR if none
+simd_isa simd_detect();
+const char *simd_name(simd_isa isa);
+// Row kernel of the instruction set, NULL for SIMD_SCALAR, for frames
+// narrower than a vector and for every binomial Gaussian (GAUSS_SIZE 3, 5,
+// 7 or 9), which run on the scalar kernels
+simd_row_fn simd_row(simd_isa isa, int width);
+
+void simd_row_avx2(simd_rows &s, const uint32_t *rgba, uint8_t *out, int y, int width, int height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, bool count);
+void simd_row_avx512(simd_rows &s, const uint32_t *rgba, uint8_t *out, int y, int width, int height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, bool count);
+
+#endif // SIMD_ROWS_H
@@ -0,0 +1,439 @@
+/* Row kernels of simd_rows.h, included by the translation unit of every
+ * instruction set after it defined the lane wrapper V:
+ *
+ * V::N pixels of 16-bit lanes in V::vec, lane masks in V::mask, loads and
+ * stores of bytes and RGBA words, lane-wise arithmetic, compares and
+ * select(m, a, b) picking a where m is set.
+ *
+ * The scalar helpers below handle the columns and rows next to the frame
+ * and line starts, where the stages mask window taps or pick up the line
+ * buffer columns of the row before, and the tails of the rows.
+ */
+
+#ifndef SIMD_ROWS_IMPL_H
+#define SIMD_ROWS_IMPL_H
+
+#include <string.h>
+#include <algorithm>
+#include "canny.h"
+#include "simd_rows.h"
+
+static const uint8_t gauss5[5][5] = {{1,4,7,4,1},{4,16,26,16,4},{7,26,41,26,7},{4,16,26,16,4},{1,4,7,4,1}};
+static const uint8_t cordic_step[10] = {45,27,14,7,3,2,1,0,0,0};
+
+// Row of a ring, back rows before the newest
+static inline uint8_t *ring_row(std::vector<uint8_t> *ring, int n, int k, int back)
+{
+	return ring[(k - back + n) % n].data();
+}
+
+static inline uint8_t *ring_push(std::vector<uint8_t> *ring, int n, int &k)
+{
+	k = (k + 1) % n;
+	return ring[k].data();
+}
+
+static inline uint8_t grey_px(uint32_t data)
+{
+	uint8_t r = data & 0xFF, g = (data >> 8) & 0xFF, b = (data >> 16) & 0xFF;
+	return (r>>2) + (r>>5) + (b>>4) + (b>>5) + (g>>1) + (g>>4);
+}
+
+// 5x5 Gaussian centred at (x-2, y-2), taps outside the frame masked
+static inline uint8_t gauss_at(simd_rows &s, int x, int y)
+{
+	int32_t result = 0;
+	for (int i = 0; i < 5; i++)
+	{
+		if (y - 4 + i < 0)
+			continue;
+		const uint8_t *row = ring_row(s.grey, 5, s.grey_k, 4 - i);
+		for (int j = 0; j < 5; j++)
+			if (x - 4 + j >= 0)
+				result += row[x - 4 + j] * gauss5[i][j];
+	}
+	return (uint8_t) (result / 273);
+}
+
+static inline uint8_t quantize(int16_t angle)
+{
+	if (angle < 0)
+		angle += 180;
+	if (angle <= 22 || angle >= 158)
+		return 0;
+	else if (angle <= 67)
+		return 1;
+	else if (angle <= 112)
+		return 2;
+	else
+		return 3;
+}
+
+static inline void gradient_px(int16_t i_x, int16_t i_y, uint32_t mask, uint8_t &value, uint8_t &dir)
+{
+	if (mask == 1)
+	{
+		int16_t x = i_x, y = i_y, atan = 0;
+		for (int j = 1; j < CORDIC_ITERATIONS; j++)
+		{
+			bool sigma = (x >= 0) != (y >= 0);
+			int16_t xn = sigma ? x - (y >> (j - 1)) : x + (y >> (j - 1));
+			int16_t yn = sigma ? y + (x >> (j - 1)) : y - (x >> (j - 1));
+			atan = sigma ? atan - cordic_step[j - 1] : atan + cordic_step[j - 1];
+			x = xn;
+			y = yn;
+		}
+		uint16_t m = (x >= 0) ? x : -x;
+		value = (uint8_t) ((m>>1) + (m>>2) - (m>>3) - (m>>4) + (m>>5) + (m>>6));
+		dir = quantize(atan);
+		return;
+	}
+
+	uint16_t abs_x = (i_x >= 0) ? i_x : -i_x;
+	uint16_t abs_y = (i_y >= 0) ? i_y : -i_y;
+	if (mask == 3 || mask == 4)
+	{
+		uint16_t big = std::max(abs_x, abs_y), small = std::min(abs_x, abs_y);
+		uint16_t m = (mask == 3) ? abs_x + abs_y : big - (big >> 4) + (small >> 1) - (small >> 5);
+		value = (m > 255) ? 255 : m;
+	}
+	else
+	{
+		int32_t sum = i_x * i_x + i_y * i_y;
+		value = (uint8_t) hls::sqrt(sum);
+	}
+	if (mask == 0)
+	{
+		dir = quantize((int16_t) (hls::atan2(i_y, i_x) * 180 / M_PI));
+		return;
+	}
+
+	if (((uint32_t) abs_y << 7) <= (uint32_t) abs_x * 53)
+		dir = 0;
+	else if (((uint32_t) abs_x << 7) <= (uint32_t) abs_y * 53)
+		dir = 2;
+	else
+		dir = ((i_x >= 0) == (i_y >= 0)) ? 1 : 3;
+}
+
+// Sobel centred at (x-1, y-1). Columns before 2 are not in the line buffer,
+// the window still holds the last column of the row before there.
+static inline void sobel_at(simd_rows &s, int x, int width, uint32_t mask, uint8_t &value, uint8_t &dir)
+{
+	int16_t w[3][3];
+	for (int c = 0; c < 3; c++)
+	{
+		int col = x - 2 + c;
+		for (int r = 0; r < 3; r++)
+			w[r][c] = (col >= 2) ? ring_row(s.blur, 4, s.blur_k, 2 - r)[col]
+					: ring_row(s.blur, 4, s.blur_k, 3 - r)[width - 1];
+	}
+	int16_t i_x = w[0][2] - w[0][0] + 2 * (w[1][2] - w[1][0]) + w[2][2] - w[2][0];
+	int16_t i_y = w[0][0] + 2 * w[0][1] + w[0][2] - w[2][0] - 2 * w[2][1] - w[2][2];
+	gradient_px(i_x, i_y, mask, value, dir);
+}
+
+// Non-maximum suppression centred at (x-1, y-1), columns before 3 as in sobel_at
+static inline uint8_t suppression_at(simd_rows &s, int x, int width)
+{
+	uint8_t w[3][3];
+	for (int c = 0; c < 3; c++)
+	{
+		int col = x - 2 + c;
+		for (int r = 0; r < 3; r++)
+			w[r][c] = (col >= 3) ? ring_row(s.mag, 4, s.mag_k, 2 - r)[col]
+					: ring_row(s.mag, 4, s.mag_k, 3 - r)[width - 1];
+	}
+
+	uint8_t q, r;
+	switch (ring_row(s.dir, 4, s.mag_k, 1)[x - 1])
+	{
+	case 0: q = w[1][2]; r = w[1][0]; break;
+	case 1: q = w[2][0]; r = w[0][2]; break;
+	case 2: q = w[2][1]; r = w[0][1]; break;
+	default: q = w[0][0]; r = w[2][2]; break;
+	}
+	return (w[1][1] >= q && w[1][1] >= r) ? w[1][1] : 0;
+}
+
+static inline uint8_t threshold_at(uint8_t data, uint8_t high, uint8_t low)
+{
+	return (data >= high) ? STRONG : (data >= low) ? WEAK : 0;
+}
+
+
+template<class V>
+static void grey_row(const uint32_t *rgba, uint8_t *out, int width)
+{
+	int x = 0;
+	for (; x + V::N <= width; x += V::N)
+		V::store(out + x, V::grey(rgba + x));
+	for (; x < width; x++)
+		out[x] = grey_px(rgba[x]);
+}
+
+template<class V>
+static void gauss_row(simd_rows &s, uint8_t *out, int y, int width)
+{
+	const uint8_t *in = ring_row(s.grey, 5, s.grey_k, 0);
+	int x;
+
+	if (y <= 1)
+	{
+		memcpy(out, in, width);
+		return;
+	}
+	out[0] = in[0];
+	out[1] = in[1];
+	if (y <= 3)
+	{
+		for (x = 2; x < width; x++)
+			out[x] = gauss_at(s, x, y);
+		return;
+	}
+	out[2] = gauss_at(s, 2, y);
+	out[3] = gauss_at(s, 3, y);
+
+	const uint8_t *r[5];
+	for (int i = 0; i < 5; i++)
+		r[i] = ring_row(s.grey, 5, s.grey_k, 4 - i);
+
+	for (x = 4; x + V::N <= width; x += V::N)
+	{
+		// symmetric taps summed first, grouped by kernel weight
+		const uint8_t *p0 = r[0] + x - 4, *p1 = r[1] + x - 4, *p2 = r[2] + x - 4, *p3 = r[3] + x - 4, *p4 = r[4] + x - 4;
+		typename V::vec w1 = V::add(V::add(V::load(p0), V::load(p0 + 4)), V::add(V::load(p4), V::load(p4 + 4)));
+		typename V::vec w4 = V::add(V::add(V::add(V::load(p0 + 1), V::load(p0 + 3)), V::add(V::load(p4 + 1), V::load(p4 + 3))),
+				V::add(V::add(V::load(p1), V::load(p1 + 4)), V::add(V::load(p3), V::load(p3 + 4))));
+		typename V::vec w7 = V::add(V::add(V::load(p0 + 2), V::load(p4 + 2)), V::add(V::load(p2), V::load(p2 + 4)));
+		typename V::vec w16 = V::add(V::add(V::load(p1 + 1), V::load(p1 + 3)), V::add(V::load(p3 + 1), V::load(p3 + 3)));
+		typename V::vec w26 = V::add(V::add(V::load(p1 + 2), V::load(p3 + 2)), V::add(V::load(p2 + 1), V::load(p2 + 3)));
+		typename V::vec w41 = V::load(p2 + 2);
+
+		// the sum needs 17 bits, divide two partial sums by 273 through a
+		// multiply-high each, the remainder of the first carried into the second
+		typename V::vec a = V::add(V::mul(w41, V::set(41)), V::mul(w26, V::set(26)));
+		typename V::vec b = V::add(V::add(V::sll(w16, 4), V::mul(w7, V::set(7))), V::add(V::sll(w4, 2), w1));
+		typename V::vec qa = V::srl(V::mulhi(a, V::set(61456)), 8);
+		typename V::vec ra = V::sub(a, V::mul(qa, V::set(273)));
+		typename V::vec qb = V::srl(V::mulhi(V::add(ra, b), V::set(61456)), 8);
+		V::store(out + x, V::add(qa, qb));
+	}
+	for (; x < width; x++)
+		out[x] = gauss_at(s, x, y);
+}
+
+template<class V>
+static void sobel_row(simd_rows &s, uint8_t *mag, uint8_t *dir, int y, int width, uint32_t mask)
+{
+	const uint8_t *in = (y > 1) ? ring_row(s.blur, 4, s.blur_k, 0) : s.blur_row.data();
+	int x;
+
+	if (y <= 2)
+	{
+		memcpy(mag, in, width);
+		memset(dir, 0, width);
+		return;
+	}
+	for (x = 0; x < 3; x++)
+	{
+		mag[x] = in[x];
+		dir[x] = 0;
+	}
+	sobel_at(s, 3, width, mask, mag[3], dir[3]);
+
+	const uint8_t *r0 = ring_row(s.blur, 4, s.blur_k, 2), *r1 = ring_row(s.blur, 4, s.blur_k, 1), *r2 = in;
+	const typename V::vec zero = V::set(0);
+
+	for (x = 4; x + V::N <= width; x += V::N)
+	{
+		typename V::vec w00 = V::load(r0 + x - 2), w01 = V::load(r0 + x - 1), w02 = V::load(r0 + x);
+		typename V::vec w10 = V::load(r1 + x - 2), w12 = V::load(r1 + x);
+		typename V::vec w20 = V::load(r2 + x - 2), w21 = V::load(r2 + x - 1), w22 = V::load(r2 + x);
+
+		typename V::vec gx = V::add(V::add(V::sub(w02, w00), V::sub(w22, w20)), V::sll(V::sub(w12, w10), 1));
+		typename V::vec gy = V::sub(V::add(V::add(w00, w02), V::sll(w01, 1)), V::add(V::add(w20, w22), V::sll(w21, 1)));
+		typename V::vec value, sector;
+
+		if (mask == 1)
+		{
+			typename V::vec cx = gx, cy = gy, atan = zero;
+			for (int j = 1; j < CORDIC_ITERATIONS; j++)
+			{
+				typename V::mask sigma = V::mxor(V::lt(cx, zero), V::lt(cy, zero));
+				typename V::vec sx = V::sra(cy, j - 1), sy = V::sra(cx, j - 1), step = V::set(cordic_step[j - 1]);
+				typename V::vec nx = V::select(sigma, V::sub(cx, sx), V::add(cx, sx));
+				cy = V::select(sigma, V::add(cy, sy), V::sub(cy, sy));
+				atan = V::select(sigma, V::sub(atan, step), V::add(atan, step));
+				cx = nx;
+			}
+			typename V::vec m = V::abs(cx);
+			value = V::sub(V::add(V::add(V::srl(m, 1), V::srl(m, 2)), V::add(V::srl(m, 5), V::srl(m, 6))),
+					V::add(V::srl(m, 3), V::srl(m, 4)));
+			value = V::band(value, V::set(0xFF));
+
+			atan = V::select(V::lt(atan, zero), V::add(atan, V::set(180)), atan);
+			typename V::mask d0 = V::mor(V::lt(atan, V::set(23)), V::lt(V::set(157), atan));
+			sector = V::select(V::lt(atan, V::set(113)), V::set(2), V::set(3));
+			sector = V::select(V::lt(atan, V::set(68)), V::set(1), sector);
+			sector = V::select(d0, zero, sector);
+		}
+		else
+		{
+			// |Gy|*128 overflows 16 bits past 511, where it exceeds 53*|Gx| anyway
+			typename V::vec ax = V::abs(gx), ay = V::abs(gy), lim = V::set(512);
+
+			if (mask == 3 || mask == 4)
+			{
+				// |Gx|+|Gy| or alpha max plus beta min, saturated to a byte
+				typename V::mask wide = V::lt(ay, ax);
+				typename V::vec big = V::select(wide, ax, ay), small = V::select(wide, ay, ax);
+				value = (mask == 3) ? V::add(ax, ay)
+						: V::sub(V::add(V::sub(big, V::srl(big, 4)), V::srl(small, 1)), V::srl(small, 5));
+				value = V::select(V::lt(value, V::set(255)), value, V::set(255));
+			}
+			else
+				value = V::magnitude(gx, gy);
+
+			typename V::mask d0 = V::mand(V::lt(ay, lim), V::ge_u(V::mul(ax, V::set(53)), V::sll(ay, 7)));
+			typename V::mask d2 = V::mand(V::lt(ax, lim), V::ge_u(V::mul(ay, V::set(53)), V::sll(ax, 7)));
+			typename V::mask diag = V::mxor(V::lt(gx, zero), V::lt(gy, zero));
+			sector = V::select(diag, V::set(3), V::set(1));
+			sector = V::select(d2, V::set(2), sector);
+			sector = V::select(d0, zero, sector);
+		}
+
+		V::store(mag + x, value);
+		if (mask == 0)
+		{
+			// angle through atan2 per pixel
+			V::store16(s.grad_x.data() + x, gx);
+			V::store16(s.grad_y.data() + x, gy);
+			for (int i = x; i < x + V::N; i++)
+				dir[i] = quantize((int16_t) (hls::atan2(s.grad_y[i], s.grad_x[i]) * 180 / M_PI));
+		}
+		else
+			V::store(dir + x, sector);
+	}
+	for (; x < width; x++)
+		sobel_at(s, x, width, mask, mag[x], dir[x]);
+}
+
+template<class V>
+static void suppression_row(simd_rows &s, uint8_t *out, int y, int width, uint8_t high, uint8_t low)
+{
+	const uint8_t *in = (y > 2) ? ring_row(s.mag, 4, s.mag_k, 0) : s.mag_row.data();
+	int x;
+
+	// threshold right behind, the suppressed row itself is not kept
+	if (y <= 3)
+	{
+		memcpy(out, in, width);
+		return;
+	}
+	for (x = 0; x < 4; x++)
+		out[x] = in[x];
+	out[4] = threshold_at(suppression_at(s, 4, width), high, low);
+
+	const uint8_t *r0 = ring_row(s.mag, 4, s.mag_k, 2), *r1 = ring_row(s.mag, 4, s.mag_k, 1), *r2 = in;
+	const uint8_t *d1 = ring_row(s.dir, 4, s.mag_k, 1);
+	const typename V::vec vhigh = V::set(high), vlow = V::set(low);
+
+	for (x = 5; x + V::N <= width; x += V::N)
+	{
+		typename V::vec c = V::load(r1 + x - 1), sector = V::load(d1 + x - 1);
+		typename V::mask s0 = V::eq(sector, V::set(0)), s1 = V::eq(sector, V::set(1)), s2 = V::eq(sector, V::set(2));
+
+		typename V::vec q = V::select(s0, V::load(r1 + x), V::select(s1, V::load(r2 + x - 2),
+				V::select(s2, V::load(r2 + x - 1), V::load(r0 + x - 2))));
+		typename V::vec r = V::select(s0, V::load(r1 + x - 2), V::select(s1, V::load(r0 + x),
+				V::select(s2, V::load(r0 + x - 1), V::load(r2 + x))));
+		typename V::vec supp = V::select(V::mand(V::ge_u(c, q), V::ge_u(c, r)), c, V::set(0));
+
+		typename V::vec t = V::select(V::ge_u(supp, vhigh), V::set(STRONG),
+				V::select(V::ge_u(supp, vlow), V::set(WEAK), V::set(0)));
+		V::store(out + x, t);
+	}
+	for (; x < width; x++)
+		out[x] = threshold_at(suppression_at(s, x, width), high, low);
+}
+
+template<class V>
+static void hysteresis_row(simd_rows &s, uint8_t *out, int y, int width)
+{
+	int x;
+
+	if (y <= 5)
+	{
+		memset(out, 0, width);
+		return;
+	}
+	memset(out, 0, 6);
+
+	const uint8_t *r0 = ring_row(s.thres, 3, s.thres_k, 2), *r1 = ring_row(s.thres, 3, s.thres_k, 1);
+	const uint8_t *r2 = ring_row(s.thres, 3, s.thres_k, 0);
+	const typename V::vec strong = V::set(STRONG), weak = V::set(WEAK);
+
+	// weak centres next to a strong pixel other than the left one
+	for (x = 6; x + V::N <= width; x += V::N)
+	{
+		typename V::vec c = V::load(r1 + x - 1);
+		typename V::mask near = V::mor(V::mor(V::mor(V::eq(V::load(r0 + x - 2), strong), V::eq(V::load(r0 + x - 1), strong)),
+				V::mor(V::eq(V::load(r0 + x), strong), V::eq(V::load(r1 + x), strong))),
+				V::mor(V::mor(V::eq(V::load(r2 + x - 2), strong), V::eq(V::load(r2 + x - 1), strong)),
+				V::eq(V::load(r2 + x), strong)));
+		V::store(out + x, V::select(V::eq(c, weak), V::select(near, strong, V::set(0)), c));
+	}
+	for (; x < width; x++)
+	{
+		uint8_t c = r1[x - 1];
+		bool near = false;
+		for (int j = -2; j <= 0; j++)
+			near |= r0[x + j] == STRONG || r2[x + j] == STRONG;
+		near |= r1[x] == STRONG;
+		out[x] = (c == WEAK) ? (near ? STRONG : 0) : c;
+	}
+
+	// the window keeps the resolved centre, so a weak pixel also follows
+	// the one on its left
+	uint8_t left = r1[4];
+	for (x = 6; x < width; x++)
+	{
+		if (r1[x - 1] == WEAK && left == STRONG)
+			out[x] = STRONG;
+		left = out[x];
+	}
+}
+
+/* One row through the chain, the counterpart of canny_row()
+ */
+template<class V>
+static void simd_row_impl(simd_rows &s, const uint32_t *rgba, uint8_t *out, int y, int width, int height,
+		uint32_t mask, uint8_t high, uint8_t low, uint8_t hyst_mode, bool count)
+{
+	grey_row<V>(rgba, ring_push(s.grey, 5, s.grey_k), width);
+
+	gauss_row<V>(s, (y > 1) ? ring_push(s.blur, 4, s.blur_k) : s.blur_row.data(), y, width);
+
+	uint8_t *mag = s.mag_row.data(), *dir = s.dir_row.data();
+	if (y > 2)
+	{
+		mag = ring_push(s.mag, 4, s.mag_k);
+		dir = s.dir[s.mag_k].data();
+	}
+	sobel_row<V>(s, mag, dir, y, width, mask);
+	if (count && y > 2)
+		for (int x = 3; x < width; x++)
+			s.bins[mag[x]]++;
+
+	uint8_t *thres = (y > 3) ? ring_push(s.thres, 3, s.thres_k) : s.thres_row.data();
+	suppression_row<V>(s, thres, y, width, high, low);
+
+	if (hyst_mode == HYST_EXACT)
+		memcpy(out, thres, width);
+	else
+		hysteresis_row<V>(s, out, y, width);
+	(void) height;
+}
+
+#endif // SIMD_ROWS_IMPL_H
@@ -0,0 +1,119 @@
+/* Work-stealing thread pool of the host drivers
+ */
+
+#include "thread_pool.h"
+
+
+/* threads - number of threads including the caller of run()
+ */
+thread_pool::thread_pool(int threads) : queued(0), pending(0), stop(false)
+{
+	if (threads < 1)
+		threads = 1;
+	for (int i = 0; i < threads; i++)
+		queues.push_back(std::unique_ptr<task_queue>(new task_queue));
+	for (int i = 1; i < threads; i++)
+		workers.push_back(std::thread(&thread_pool::work, this, i));
+}
+
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		stop = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+
+/* Take a task from the back of the own queue, else steal from the front
+ * of the next queue that has one
+ */
+bool thread_pool::pop(int self, const std::function<void()>* &task)
+{
+	for (int i = 0; i < size(); i++)
+	{
+		task_queue &q = *queues[(self + i) % size()];
+		std::lock_guard<std::mutex> l(q.lock);
+		if (q.tasks.empty())
+			continue;
+		if (i == 0)
+		{
+			task = q.tasks.back();
+			q.tasks.pop_back();
+		}
+		else
+		{
+			task = q.tasks.front();
+			q.tasks.pop_front();
+		}
+		queued--;
+		return true;
+	}
+	return false;
+}
+
+
+void thread_pool::finish()
+{
+	if (--pending == 0)
+	{
+		std::lock_guard<std::mutex> l(lock);
+		done.notify_all();
+	}
+}
+
+
+void thread_pool::work(int self)
+{
+	const std::function<void()> *task;
+
+	for (;;)
+	{
+		if (pop(self, task))
+		{
+			(*task)();
+			finish();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> l(lock);
+		wake.wait(l, [&]() { return stop || queued > 0; });
+		if (stop)
+			return;
+	}
+}
+
+
+void thread_pool::run(const std::vector<std::function<void()>> &tasks)
+{
+	const std::function<void()> *task;
+
+	if (tasks.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> l(lock);
+		pending = tasks.size();
+		for (size_t i = 0; i < tasks.size(); i++)
+		{
+			task_queue &q = *queues[i % size()];
+			std::lock_guard<std::mutex> ql(q.lock);
+			q.tasks.push_back(&tasks[i]);
+			queued++;
+		}
+	}
+	wake.notify_all();
+
+	while (pop(0, task))
+	{
+		(*task)();
+		finish();
+	}
+
+	std::unique_lock<std::mutex> l(lock);
+	done.wait(l, [&]() { return pending == 0; });
+}
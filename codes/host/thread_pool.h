@@ -0,0 +1,49 @@
+/* Work-stealing thread pool of the host drivers
+ *
+ * Every worker owns a deque of tasks. It takes its own tasks from the back
+ * and, once it runs dry, steals from the front of the others, so uneven
+ * tasks still keep all cores busy.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class thread_pool {
+public:
+	explicit thread_pool(int threads);
+	~thread_pool();
+
+	// Run the tasks and return once all of them finished, the calling
+	// thread works along as one of the threads
+	void run(const std::vector<std::function<void()>> &tasks);
+
+	int size() const { return (int) queues.size(); }
+
+private:
+	struct task_queue {
+		std::mutex lock;
+		std::deque<const std::function<void()>*> tasks;
+	};
+
+	bool pop(int self, const std::function<void()>* &task);
+	void finish();
+	void work(int self);
+
+	std::vector<std::unique_ptr<task_queue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	std::atomic<size_t> queued, pending;
+	bool stop;
+};
+
+#endif // THREAD_POOL_H
@@ -2,163 +2,950 @@
  * Original by Michiel van der Vlag, adapted by Matti Dreef
  */
 
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include "streamulator.h"
 
 
-/* Load image from file into pixel stream
+// Header of raw frames and of the cache, followed by the packed RGBA words
+struct raw_header {
+	char magic[8];
+	uint32_t width, height;
+};
+
+static const char RAW_MAGIC[8] = "RGBARAW";
+
+
+input_frame::~input_frame()
+{
+#ifndef _WIN32
+	if (map)
+		munmap(map, map_size);
+#endif
+}
+
+
+/* Map a file read-only, or read it where mmap is not available
+ *
+ * filename - path to the file
+ * frame    - takes the mapping, so it lives as long as the frame
+ * bytes    - returns the contents
+ */
+static bool mapFile(const std::string &filename, input_frame &frame, const uint8_t *&bytes, size_t &size)
+{
+#ifndef _WIN32
+	int fd = open(filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return false;
+
+	if (frame.map)
+		munmap(frame.map, frame.map_size);
+	frame.map = map;
+	frame.map_size = st.st_size;
+	bytes = (const uint8_t *) map;
+	size = st.st_size;
+	return true;
+#else
+	std::ifstream f(filename.c_str(), std::ios::binary);
+	std::vector<char> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	if (data.empty())
+		return false;
+	frame.words.resize((data.size() + 3) / 4);
+	memcpy(frame.words.data(), data.data(), data.size());
+	bytes = (const uint8_t *) frame.words.data();
+	size = data.size();
+	return true;
+#endif
+}
+
+
+// 64-bit FNV-1a of the image file, names its converted frame in the cache
+static uint64_t hashBytes(const uint8_t *bytes, size_t size)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++)
+		h = (h ^ bytes[i]) * 1099511628211ULL;
+	return h;
+}
+
+
+/* Take the words of a raw frame in place
+ */
+static bool rawFrame(const uint8_t *bytes, size_t size, input_frame &frame)
+{
+	const raw_header *h = (const raw_header *) bytes;
+	if (size < sizeof(raw_header) || memcmp(h->magic, RAW_MAGIC, sizeof(RAW_MAGIC))
+			|| size < sizeof(raw_header) + (size_t)h->width * h->height * 4)
+		return false;
+
+	frame.width = h->width;
+	frame.height = h->height;
+	frame.rgba = (const uint32_t *)(bytes + sizeof(raw_header));
+	return true;
+}
+
+
+/* Next number of a PPM header within [p, end), after whitespace and
+ * comments. Values above 65535 are rejected, the tops take 16-bit sizes.
+ */
+static bool ppmField(const uint8_t *&p, const uint8_t *end, int &value)
+{
+	while (p < end && (isspace(*p) || *p == '#'))
+	{
+		if (*p == '#')
+			while (p < end && *p != '\n')
+				p++;
+		else
+			p++;
+	}
+	if (p == end || !isdigit(*p))
+		return false;
+
+	value = 0;
+	while (p < end && isdigit(*p))
+	{
+		value = value * 10 + (*p++ - '0');
+		if (value > 65535)
+			return false;
+	}
+	return true;
+}
+
+
+/* Pack the pixels of a binary PPM (P6), without OpenCV
+ */
+static bool ppmFrame(const uint8_t *bytes, size_t size, input_frame &frame)
+{
+	const uint8_t *end = bytes + size, *p = bytes + 2;
+	int width, height, maxval;
+	if (size < 2 || bytes[0] != 'P' || bytes[1] != '6' || !ppmField(p, end, width) || !ppmField(p, end, height)
+			|| !ppmField(p, end, maxval) || maxval != 255 || width == 0 || height == 0 || p == end || !isspace(*p))
+		return false;
+
+	// a single whitespace byte separates the header from the pixels
+	const uint8_t *rgb = p + 1;
+	if ((size_t)width * height * 3 > (size_t)(end - rgb))
+		return false;
+
+	std::vector<uint32_t> words((size_t)width * height);
+	for (size_t i = 0; i < words.size(); i++)
+		words[i] = 0xFF000000 | (rgb[3*i+2] << 16) | (rgb[3*i+1] << 8) | rgb[3*i];
+
+	frame.words.swap(words);
+	frame.rgba = frame.words.data();
+	frame.width = width;
+	frame.height = height;
+	return true;
+}
+
+
+/* Store a converted frame in the cache, a failed write only costs the
+ * decoding next run
+ */
+static void saveRaw(const std::string &filename, const input_frame &frame)
+{
+	raw_header h;
+	memcpy(h.magic, RAW_MAGIC, sizeof(RAW_MAGIC));
+	h.width = frame.width;
+	h.height = frame.height;
+
+	std::string tmp = filename + ".tmp";
+	std::ofstream f(tmp.c_str(), std::ios::binary);
+	f.write((const char *) &h, sizeof(h));
+	f.write((const char *) frame.rgba, (size_t)frame.width * frame.height * 4);
+	f.close();
+	if (!f || rename(tmp.c_str(), filename.c_str()))
+		remove(tmp.c_str());
+}
+
+
+/* Load image from file for streaming it in lazily
+ *
+ * Raw frames (RGBARAW header) are mapped and PPM images packed without
+ * OpenCV. Other formats are decoded with OpenCV once and kept in
+ * INPUT_CACHE under the hash of the file, so later runs map them instead.
  *
  * filename - path to input image
- * stream   - output pixel stream
- * frames   - number of times to repeat the image
+ * frame    - returns the image as packed RGBA words
  */
-void loadStream(const std::string &filename, pixel_stream &stream, int frames)
+void loadImage(const std::string &filename, input_frame &frame)
 {
-	cv::Mat srcImg;
+	auto start = std::chrono::steady_clock::now();
+	const uint8_t *bytes;
+	size_t size;
+	const char *source = "decoded";
 
-	// Read input image
-	srcImg = cv::imread(filename);
-	if (srcImg.data == NULL)
+	if (!mapFile(filename, frame, bytes, size))
 	{
 		std::cout << "##### Invalid input image, check the INPUT_IMG path #####" << std::endl;
 		throw;
 	}
 
-	// A necessary conversion to obtain the right format
-	cv::cvtColor(srcImg, srcImg, CV_BGR2RGBA);
+	if (rawFrame(bytes, size, frame))
+		source = "raw";
+	else if (ppmFrame(bytes, size, frame))
+		source = "ppm";
+	else
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "canny_%016llx.rgba", (unsigned long long) hashBytes(bytes, size));
+		std::string cached = std::string(INPUT_CACHE) + name;
+		input_frame cache;
+
+		if (INPUT_CACHE[0] && mapFile(cached, cache, bytes, size) && rawFrame(bytes, size, cache))
+		{
+			// hand the mapping of the cache over to the frame
+			std::swap(frame.map, cache.map);
+			std::swap(frame.map_size, cache.map_size);
+			frame.words.swap(cache.words);
+			frame.rgba = cache.rgba;
+			frame.width = cache.width;
+			frame.height = cache.height;
+			source = "cached";
+		}
+		else
+		{
+			cv::Mat img = cv::imread(filename);
+			if (img.data == NULL)
+			{
+				std::cout << "##### Invalid input image, check the INPUT_IMG path #####" << std::endl;
+				throw;
+			}
+			cv::cvtColor(img, img, CV_BGR2RGBA);
+
+			frame.words.resize((size_t)img.cols * img.rows);
+			for (int y = 0; y < img.rows; y++)
+				for (int x = 0; x < img.cols; x++)
+				{
+					cv::Vec4b v = img.at<cv::Vec4b>(y, x);
+					frame.words[(size_t)y * img.cols + x] = v[0] | (v[1] << 8) | (v[2] << 16) | ((uint32_t) v[3] << 24);
+				}
+			frame.rgba = frame.words.data();
+			frame.width = img.cols;
+			frame.height = img.rows;
+			if (INPUT_CACHE[0])
+				saveRaw(cached, frame);
+		}
+	}
+
+	double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3;
+	std::cout << "input " << frame.width << "x" << frame.height << ", " << source << " in " << ms << " ms" << std::endl;
+}
+
+
+/* Pixel i of an image repeated frame after frame, like cvMat2AXIvideo
+ */
+inline pixel_data imagePixel(const input_frame &img, size_t i)
+{
+	size_t offset = i % ((size_t)img.width * img.height);
+	pixel_data p;
+
+	p.data = img.rgba[offset];
+	p.keep = -1;
+	p.strb = -1;
+	p.user = (offset == 0);
+	p.last = (offset % img.width == (size_t)img.width - 1);
+	p.id = 0;
+	p.dest = 0;
+	return p;
+}
+
+
+// Room for another beat in a FIFO of FIFO_DEPTH entries
+template<typename S>
+bool hasRoom(S &s)
+{
+	return FIFO_DEPTH == 0 || s.size() < FIFO_DEPTH;
+}
+
+
+// Stage of the clocked simulation and the FIFO it writes
+struct sim_stage {
+	const char *name;
+	std::function<bool()> ready_in, ready_out;
+	std::function<size_t()> occupancy;
+	std::function<void()> fire;
+	uint64_t stall_in, stall_out;
+	size_t max_occupancy;
+
+	// Fire once if the input holds a beat and the output has room
+	bool step() {
+		if (!ready_in()) {
+			stall_in++;
+			return false;
+		}
+		if (!ready_out()) {
+			stall_out++;
+			return false;
+		}
+		fire();
+		return true;
+	}
+};
 
-	// Write input data
-	for (int frame=0; frame < frames; frame++)
-		cvMat2AXIvideo(srcImg, stream);
+template<typename SI, typename SO>
+sim_stage simStage(const char *name, SI &in, SO &out, std::function<void()> fire)
+{
+	sim_stage s;
+	s.name = name;
+	s.ready_in = [&in]() { return !in.empty(); };
+	s.ready_out = [&out]() { return hasRoom(out); };
+	s.occupancy = [&out]() { return (size_t) out.size(); };
+	s.fire = fire;
+	s.stall_in = s.stall_out = 0;
+	s.max_occupancy = 0;
+	return s;
 }
 
+#if NARROW_STREAM
+#define STAGE(f) f##8
+#else
+#define STAGE(f) f
+#endif
+
 
 /* Process image stream
  *
- * src - source (input) stream
- * dst - destination (output) stream
+ * Runs the stages clock by clock with FIFO_DEPTH deep FIFOs between them.
+ * Every cycle each stage fires once if its input holds a beat and its
+ * output has room, the last stage first, so a beat advances one stage per
+ * cycle and backpressure travels upstream like in the dataflow pipeline.
+ * The source is only asked for a pixel when the input FIFO has room, so the
+ * streams never hold more than FIFO_DEPTH beats. The maximum occupancy of
+ * every FIFO is reported with the smallest depth it allows. The stages fire
+ * in a single cycle without the pipeline latency of the synthesized ones, so
+ * that depth is only a lower bound.
+ *
+ * source    - produces the next input pixel, false at the end of the input
+ * sink      - takes every output pixel
+ * width     - active frame width
+ * height    - active frame height
+ * hyst_mode - 1 runs the exact hysteresis when HYST_MODE is set, else the 3x3 window
  */
-void processStream(pixel_stream &src ,pixel_stream &dst)
+void processStream(std::function<bool(pixel_data&)> source, std::function<void(pixel_data&)> sink,
+		uint16_t width, uint16_t height, uint8_t hyst_mode)
 {
+	pixel_stream src, dst;
+#if NARROW_STREAM
+	grey_stream grey, blur, conv, suppress, thres;
+#else
 	pixel_stream grey, blur, conv, suppress, thres;
-	int16_t angle;
+#endif
 	uint32_t mask = 1;
+	uint16_t thresholds = 0;
+	perf_counters perf[6] = {};
+	std::vector<sim_stage> stages;
+
+#if FUSED_FRONT
+	stages.push_back(simStage("front", src, conv, [&]() {
+		STAGE(front)(src, conv, mask, width, height, THRES_MODE, 0, 0, thresholds, perf[0]); }));
+#else
+	stages.push_back(simStage("greyscale", src, grey, [&]() { STAGE(greyscale)(src, grey, perf[0]); }));
+	stages.push_back(simStage("gauss", grey, blur, [&]() { STAGE(gauss)(grey, blur, width, height, perf[1]); }));
+	stages.push_back(simStage("sobel", blur, conv, [&]() {
+		STAGE(sobel)(blur, conv, mask, width, height, THRES_MODE, 0, 0, thresholds, perf[2]); }));
+#endif
+	stages.push_back(simStage("suppression", conv, suppress, [&]() {
+		STAGE(suppression)(conv, suppress, width, height, perf[3]); }));
+	stages.push_back(simStage("threshold", suppress, thres, [&]() { STAGE(threshold)(suppress, thres, perf[4]); }));
+#if HYST_MODE
+	if (hyst_mode)
+		stages.push_back(simStage("hysteresis", thres, dst, [&]() {
+			STAGE(hysteresis_exact)(thres, dst, width, height, perf[5]); }));
+	else
+#endif
+		stages.push_back(simStage("hysteresis", thres, dst, [&]() {
+			STAGE(hysteresis)(thres, dst, width, height, perf[5]); }));
+
+	pixel_data pixel;
+	bool more = true, busy = true;
+	uint64_t cycles = 0, pixels = 0;
+
+	while (busy)
+	{
+		busy = false;
+
+		if (!dst.empty())
+		{
+			dst >> pixel;
+			sink(pixel);
+			busy = true;
+		}
+
+		for (int i = stages.size() - 1; i >= 0; i--)
+			busy |= stages[i].step();
+
+		if (more && hasRoom(src))
+		{
+			more = source(pixel);
+			if (more)
+			{
+				src << pixel;
+				pixels++;
+				busy = true;
+			}
+		}
+
+		for (size_t i = 0; i < stages.size(); i++)
+			stages[i].max_occupancy = std::max(stages[i].max_occupancy, stages[i].occupancy());
+
+		if (busy)
+			cycles++;
+	}
+
+	for (size_t i = 0; i < stages.size(); i++)
+		if (stages[i].ready_in())
+		{
+			std::cout << "##### Deadlock after " << cycles << " cycles, " << stages[i].name << " can not advance #####" << std::endl;
+			break;
+		}
 
-	while (!src.empty()){
-		greyscale(src, grey);
-		gauss(grey, blur);
-		angle = sobel(blur, conv, mask);
-		suppression(conv, suppress, angle);
-		threshold(suppress, thres);
-		hysteresis(thres, dst);
+	std::cout << pixels << " pixels in " << cycles << " cycles" << std::endl;
+	std::cout << "Thresholds: HIGH " << (thresholds & 0xFF) << ", LOW " << (thresholds >> 8) << std::endl;
+
+	// An output FIFO that never held more than one beat is not a bottleneck
+	// here, the HLS default depth of 2 covers it. Without the stage latency
+	// the depths are lower bounds, cosimulation sizes the real FIFOs.
+	for (size_t i = 0; i < stages.size(); i++)
+	{
+		int k = FUSED_FRONT && i > 0 ? i + 2 : i;
+		size_t depth = std::max(stages[i].max_occupancy, (size_t) 2);
+		std::cout << stages[i].name << ": " << perf[k].frames << " frames, " << perf[k].pixels << " pixels, "
+				<< stages[i].stall_in << "/" << stages[i].stall_out << " stalls in/out, "
+				<< perf[k].errors << " framing errors, output FIFO max " << stages[i].max_occupancy;
+		if (FIFO_DEPTH && stages[i].max_occupancy == FIFO_DEPTH && stages[i].stall_out)
+			std::cout << ", full: rerun with a larger FIFO_DEPTH to size it" << std::endl;
+		else
+			std::cout << " -> at least #pragma HLS STREAM depth=" << depth << std::endl;
 	}
 }
 
-/* Save raw pixel stream to file
+
+// Frames a check runs before it compares. The first only settles the line
+// buffers since it depends on what ran before, two more for the thresholds,
+// which frames narrower than 64 pixels take from the histogram two frames
+// back, and one more for the exact hysteresis a frame late.
+#define SETTLE_FRAMES (1 + 2*(THRES_MODE != 0) + HYST_MODE)
+
+
+/* Check the N pixels per clock pipeline against processStream
+ *
+ * The PPC stages take whole beats per line, so images whose width is not a
+ * multiple of N are skipped.
  *
- * src      - input pixel stream
- * dst      - passthrough of pixel stream
- * filename - path to output image
+ * img      - input image
+ * frames   - number of frames to run, the first SETTLE_FRAMES are not compared
  */
-void saveRawStream(pixel_stream &src, pixel_stream &dst, const std::string &filename)
+template<int N>
+bool testPPC(const input_frame &img, int frames)
 {
-	std::vector<ap_uint<32>> pixeldata;
+	pixel_stream ref;
+	typename ppc_types<N>::rgba_stream wideSrc, wideDst;
+	typename ppc_types<N>::grey_stream grey, blur, conv, suppress, thres;
+	typename ppc_types<N>::rgba_beat beat;
+	std::vector<pixel_data> pixels;
 	pixel_data pixel;
+	uint32_t mask = 1;
+	uint16_t thresholds;
+	perf_counters perf[6] = {};
+	int width, height;
+
+	width = img.width;
+	height = img.height;
+	if (width % N)
+	{
+		std::cout << N << " pixels per clock: skipped, width " << width << " is not a multiple of " << N << std::endl;
+		return true;
+	}
+
+	for (size_t i = 0; i < (size_t)width * height * frames; i++)
+		pixels.push_back(imagePixel(img, i));
+
+	// One pixel per clock reference, with the 3x3 window like hysteresis_ppc
+	size_t next = 0;
+	processStream([&](pixel_data &p) {
+			if (next == pixels.size())
+				return false;
+			p = pixels[next++];
+			return true;
+		}, [&](pixel_data &p) { ref << p; }, width, height, 0);
+
+	// Pack N pixels of a line into every beat
+	for (size_t i = 0; i < pixels.size(); i += N)
+	{
+		beat.keep = -1;
+		beat.strb = -1;
+		beat.user = pixels[i].user;
+		beat.last = pixels[i+N-1].last;
+		beat.id = 0;
+		beat.dest = 0;
+		for (int k = 0; k < N; k++)
+			beat.data.range(32*k+31, 32*k) = pixels[i+k].data;
+		wideSrc << beat;
+	}
+
+	while (!wideSrc.empty())
+	{
+		greyscale_ppc<N>(wideSrc, grey, perf[0]);
+		gauss_ppc<N>(grey, blur, width, height, perf[1]);
+		sobel_ppc<N>(blur, conv, mask, width, height, THRES_MODE, 0, 0, thresholds, perf[2]);
+		suppression_ppc<N>(conv, suppress, width, height, perf[3]);
+		threshold_ppc<N>(suppress, thres, perf[4]);
+		hysteresis_ppc<N>(thres, wideDst, width, height, perf[5]);
+	}
+
+	// Compare lane by lane after the first frame
+	size_t skip = pixels.size() / frames * SETTLE_FRAMES;
+	int mismatch = 0;
+
+	for (size_t i = 0; i < pixels.size(); i += N)
+	{
+		wideDst >> beat;
+		for (int k = 0; k < N; k++)
+		{
+			ref >> pixel;
+			uint32_t lane = beat.data.range(32*k+31, 32*k);
+			if (i >= skip && (lane & 0x00FFFFFF) != (pixel.data & 0x00FFFFFF))
+				mismatch++;
+		}
+		if (i >= skip && (beat.user != pixels[i].user || beat.last != pixel.last))
+			mismatch++;
+	}
+
+	std::cout << N << " pixels per clock: " << mismatch << " mismatches" << std::endl;
+
+	return mismatch == 0;
+}
+
 
-	// Copy source data
-	while(!src.empty())
+/* Check the dataflow top against processStream, one call per frame
+ *
+ * img      - input image
+ * frames   - number of frames to run, the first SETTLE_FRAMES are not compared
+ */
+bool testDataflow(const input_frame &img, int frames)
+{
+	pixel_stream ref, src, dst;
+	pixel_data pixel, out;
+	uint32_t mask = 1;
+	uint16_t thresholds;
+
+	int width = img.width, height = img.height;
+	size_t pixels = (size_t)width * height * frames, next = 0;
+
+	processStream([&](pixel_data &p) {
+			if (next == pixels)
+				return false;
+			p = imagePixel(img, next++);
+			return true;
+		}, [&](pixel_data &p) { ref << p; }, width, height, HYST_MODE);
+
+	int mismatch = 0;
+	for (int frame = 0; frame < frames; frame++)
 	{
-		src >> pixel;
-		pixeldata.push_back(pixel.data | 0xFF000000);
-		dst << pixel;
+		for (size_t i = 0; i < (size_t)width * height; i++)
+			src << imagePixel(img, i);
+		canny(src, dst, mask, width, height, THRES_MODE, 0, 0, HYST_MODE, thresholds);
+
+		for (size_t i = 0; i < (size_t)width * height; i++)
+		{
+			dst >> out;
+			ref >> pixel;
+			if (frame >= SETTLE_FRAMES && ((out.data & 0x00FFFFFF) != (pixel.data & 0x00FFFFFF)
+					|| out.user != pixel.user || out.last != pixel.last))
+				mismatch++;
+		}
 	}
 
-	// Compute height
-	int height = pixeldata.size() / WIDTH;
+	std::cout << "dataflow top: " << mismatch << " mismatches" << std::endl;
 
-	cv::Mat dstImg(height, WIDTH, CV_8UC4, pixeldata.data());
-	cv::cvtColor(dstImg, dstImg, CV_RGBA2BGR);
-	cv::imwrite(filename, dstImg);
+	return mismatch == 0;
 }
 
 
-/* Save valid frame from pixel stream
+/* Check the batch top against processStream, all frames in one call
  *
- * src        - input pixel stream
- * filename   - path to output image
- * skipframes - number of frames to skip before saving
+ * img      - input image
+ * frames   - number of frames to run, the first SETTLE_FRAMES are not compared
  */
-void saveValidStream(pixel_stream &src, const std::string &filename, int skipframes)
+bool testBatch(const input_frame &img, int frames)
 {
-	static ap_uint<32> pixeldata[HEIGHT][WIDTH];
+	pixel_stream ref;
 	pixel_data pixel;
+	uint32_t mask = 1;
+	uint16_t thresholds;
+
+	int width = img.width, height = img.height;
+	size_t pixels = (size_t)width * height * frames, next = 0;
+
+	processStream([&](pixel_data &p) {
+			if (next == pixels)
+				return false;
+			p = imagePixel(img, next++);
+			return true;
+		}, [&](pixel_data &p) { ref << p; }, width, height, HYST_MODE);
+
+	// Host arrays in place of the frame buffers in DDR
+	std::vector<ap_uint<32>> in(pixels);
+	std::vector<ap_uint<8>> out(pixels);
+	for (size_t i = 0; i < pixels; i++)
+		in[i] = imagePixel(img, i).data;
 
-	// Check if input stream has contents
-	if (src.empty())
+	canny_batch(in.data(), out.data(), frames, mask, width, height, THRES_MODE, 0, 0, HYST_MODE, thresholds);
+
+	size_t skip = pixels / frames * SETTLE_FRAMES;
+	int mismatch = 0;
+	for (size_t i = 0; i < pixels; i++)
 	{
-		std::cout << "##### Stream to save is empty #####" << std::endl;
-		throw;
+		ref >> pixel;
+		if (i >= skip && out[i] != (pixel.data & 0xFF))
+			mismatch++;
+	}
+
+	std::cout << "batch top: " << mismatch << " mismatches" << std::endl;
+
+	return mismatch == 0;
+}
+
+
+/* Pixel i of the image seen by camera c: as is, mirrored, upside down or
+ * inverted, so that every bank of the multi-camera chain gets other edges
+ */
+inline pixel_data cameraPixel(const input_frame &img, int c, size_t i)
+{
+	pixel_data p = imagePixel(img, i);
+	size_t offset = i % ((size_t)img.width * img.height);
+	size_t x = offset % img.width, y = offset / img.width;
+
+	if (c % 4 == 1)
+		p.data = img.rgba[y * img.width + img.width - 1 - x];
+	else if (c % 4 == 2)
+		p.data = img.rgba[(img.height - 1 - y) * img.width + x];
+	else if (c % 4 == 3)
+		p.data = img.rgba[offset] ^ 0x00FFFFFF;
+	return p;
+}
+
+
+/* Check the multi-camera top against a single stream run per camera, the
+ * rows of the cameras interleaved on one stream
+ *
+ * img      - input image
+ * frames   - number of frames to run, the first SETTLE_FRAMES are not compared
+ */
+bool testCams(const input_frame &img, int frames)
+{
+	pixel_stream src, dst;
+	cam_pixel_stream cam_src, cam_dst;
+	std::vector<pixel_stream> ref(CAMERAS);
+	pixel_data pixel, out;
+	cam_pixel_data beat;
+	uint32_t mask = 1;
+	uint16_t thresholds, cam_thresholds[CAMERAS];
+
+	int width = img.width, height = img.height;
+	size_t frame_pixels = (size_t)width * height;
+
+	// Every camera alone through the single stream top
+	for (int c = 0; c < CAMERAS; c++)
+	{
+		for (int frame = 0; frame < frames; frame++)
+		{
+			for (size_t i = 0; i < frame_pixels; i++)
+				src << cameraPixel(img, c, i);
+			canny(src, dst, mask, width, height, THRES_MODE, 0, 0, HYST_MODE, thresholds);
+			for (size_t i = 0; i < frame_pixels; i++)
+				ref[c] << dst.read();
+		}
+	}
+
+	// Row y of every camera before row y+1 of any, TDEST naming the camera
+	for (int frame = 0; frame < frames; frame++)
+		for (int y = 0; y < height; y++)
+			for (int c = 0; c < CAMERAS; c++)
+				for (int x = 0; x < width; x++)
+				{
+					pixel = cameraPixel(img, c, (size_t)y * width + x);
+					beat.data = pixel.data;
+					beat.keep = pixel.keep;
+					beat.strb = pixel.strb;
+					beat.user = pixel.user;
+					beat.last = pixel.last;
+					beat.id = pixel.id;
+					beat.dest = c;
+					cam_src << beat;
+				}
+	canny_cams(cam_src, cam_dst, frames, CAMERAS, mask, width, height, THRES_MODE, 0, 0, HYST_MODE, cam_thresholds);
+
+	size_t settle = frame_pixels * SETTLE_FRAMES;
+	int mismatch = 0;
+	std::vector<size_t> seen(CAMERAS, 0);
+	for (size_t i = 0; i < frame_pixels * frames * CAMERAS; i++)
+	{
+		cam_dst >> beat;
+		int c = beat.dest;
+		ref[c] >> out;
+		if (seen[c]++ >= settle && ((beat.data & 0x00FFFFFF) != (out.data & 0x00FFFFFF)
+				|| beat.user != out.user || beat.last != out.last))
+			mismatch++;
+	}
+
+	for (int c = 0; c < CAMERAS; c++)
+		if (seen[c] != frame_pixels * frames)
+			mismatch++;
+
+	std::cout << "multi-camera top: " << mismatch << " mismatches" << std::endl;
+
+	return mismatch == 0;
+}
+
+
+/* Output file of frame n, the path of the image with the number and
+ * extension of the format
+ */
+static std::string framePath(const std::string &filename, int n, int format)
+{
+	std::string stem = filename.substr(0, filename.find_last_of('.'));
+	char num[16];
+	snprintf(num, sizeof(num), "_%04d", n);
+
+	if (format == OUTPUT_Y4M)
+		return stem + ".y4m";
+	if (format == OUTPUT_RAW)
+		return stem + ".raw";
+	if (format == OUTPUT_PNG_SEQUENCE)
+		return stem + num + ".png";
+	return filename;
+}
+
+
+/* Writes the frames of an output stream as the pixels come in
+ *
+ * Only one frame is held, so the memory does not grow with the number of
+ * frames. PNG keeps the first valid frame only, the other formats every
+ * complete frame. The raw stream as PNG is every beat stacked into one
+ * image as tall as the stream, so it holds the whole stream.
+ *
+ * filename   - path to the output image, the other formats derive theirs
+ * skipframes - number of frames to skip before the valid frame, which
+ *              then starts at the next pixel.user, -1 to write the raw
+ *              stream from the first pixel on
+ */
+struct frame_sink {
+	frame_sink(const std::string &filename, int skipframes, int width, int height, int format)
+		: filename(filename), skip(skipframes), width(width), height(height), format(format),
+		  beats(0), delay(-1), fill(0), frames(0), missing_last(0), file(NULL)
+	{
+		pixeldata.resize((size_t)width * height);
+		luma.resize(width);
 	}
 
-	// Find start of valid frame after frame skips
-	int j = -1;
-	do
+	~frame_sink()
 	{
-		src >> pixel;
-		j++;
+		if (file)
+			fclose(file);
+	}
 
-		if (src.empty())
+	void push(const pixel_data &pixel)
+	{
+		size_t frame = (size_t)width * height;
+
+		beats++;
+		if (delay < 0)
 		{
-			std::cout << "##### No frame start found with pixel.user #####" << std::endl;
-			throw;
+			// find start of valid frame after frame skips
+			if (skip >= 0 && !(pixel.user == 1 && beats > skip * frame))
+				return;
+			delay = (skip >= 0) ? beats - 1 - skip * frame : 0;
+		}
+		if (format == OUTPUT_PNG && skip < 0)
+		{
+			stacked.push_back(pixel.data | 0xFF000000);
+			return;
 		}
-	} while (!(pixel.user == 1 && j >= skipframes*WIDTH*HEIGHT));
+		if (format == OUTPUT_PNG && frames > 0)
+			return;
 
-	int delay = j - skipframes*WIDTH*HEIGHT;
-	std::cout << "HLS delay: " << delay;
-	std::cout << "  (" << (float)delay/WIDTH << " lines)" << std::endl;
+		pixeldata[fill] = pixel.data | 0xFF000000; // OR with full alpha channel
+		if (skip >= 0 && fill % width == (size_t)width - 1 && pixel.last != 1) // check pixel.last
+			missing_last++;
+		if (++fill == frame)
+		{
+			write();
+			fill = 0;
+		}
+	}
 
-	// Read frame, keep track of lines missing pixel.last signal
-	int missing_last = 0;
+	void write()
+	{
+		if (format == OUTPUT_Y4M || format == OUTPUT_RAW)
+		{
+			if (file == NULL)
+			{
+				file = fopen(framePath(filename, 0, format).c_str(), "wb");
+				if (file && format == OUTPUT_Y4M)
+					fprintf(file, "YUV4MPEG2 W%d H%d F30:1 Ip A1:1 Cmono\n", width, height);
+			}
+			if (file == NULL)
+				return;
+			if (format == OUTPUT_Y4M)
+				fputs("FRAME\n", file);
 
-	for (int rows=0; rows < HEIGHT; rows++)
-		for (int cols=0; cols < WIDTH; cols++)
+			// edges are grey, the luma is the first channel
+			for (size_t i = 0; i < pixeldata.size(); i += width)
+			{
+				for (int x = 0; x < width; x++)
+					luma[x] = pixeldata[i + x] & 0xFF;
+				fwrite(luma.data(), 1, width, file);
+			}
+		}
+		else
 		{
-			pixeldata[rows][cols] = pixel.data | 0xFF000000; // OR with full alpha channel
+			// save image by converting data array to matrix
+			cv::Mat saveImg(height, width, CV_8UC4, pixeldata.data());
+			cv::cvtColor(saveImg, saveImg, CV_RGBA2BGR);
+			cv::imwrite(framePath(filename, frames, format), saveImg);
+		}
+		frames++;
+	}
 
-			if (cols == WIDTH-1 && pixel.last != 1) // check pixel.last
-				missing_last++;
+	// Flush the frame in flight and report, false if no frame was written
+	bool close()
+	{
+		if (beats == 0)
+		{
+			std::cout << "##### Stream to save is empty #####" << std::endl;
+			return false;
+		}
+		if (delay < 0)
+		{
+			std::cout << "##### No frame start found with pixel.user #####" << std::endl;
+			return false;
+		}
 
-			if (!src.empty()) // don't read from empty stream
-				src >> pixel;
-			else
-				goto endloop;
+		if (!stacked.empty())
+		{
+			cv::Mat saveImg(stacked.size() / width, width, CV_8UC4, stacked.data());
+			cv::cvtColor(saveImg, saveImg, CV_RGBA2BGR);
+			cv::imwrite(filename, saveImg);
+			frames++;
 		}
-endloop:
 
-	std::cout << "Number of lines missing pixel.last signal: " << missing_last << std::endl;
+		// a partial valid frame is saved like a full one when nothing else is
+		if (frames == 0 && fill > 0)
+		{
+			std::fill(pixeldata.begin() + fill, pixeldata.end(), 0xFF000000);
+			write();
+		}
+		if (file)
+			fclose(file);
+		file = NULL;
 
-	// Purge remaining data in stream
-	while (!src.empty())
-		src >> pixel;
+		if (skip >= 0)
+		{
+			std::cout << "HLS delay: " << delay;
+			std::cout << "  (" << (float)delay/width << " lines)" << std::endl;
+			std::cout << "Number of lines missing pixel.last signal: " << missing_last << std::endl;
+		}
+		return frames > 0;
+	}
 
-	// Save image by converting data array to matrix
-	cv::Mat saveImg(HEIGHT, WIDTH, CV_8UC4, pixeldata);
-	cv::cvtColor(saveImg, saveImg, CV_RGBA2BGR);
-	cv::imwrite(filename, saveImg);
-}
+	std::string filename;
+	int skip, width, height, format;
+	size_t beats;
+	long delay;
+	size_t fill;
+	int frames, missing_last;
+	std::vector<ap_uint<32>> pixeldata, stacked;
+	std::vector<uint8_t> luma;
+	FILE *file;
+};
 
 
 int main()
 {
-	pixel_stream srcStream;
-	pixel_stream procStream;
-	pixel_stream dstStream;
+	input_frame img;
+
+	// The resolution registers of the stages follow the input image, which
+	// is streamed in pixel by pixel as the pipeline takes it
+	loadImage(INPUT_IMG, img);
+	int width = img.width, height = img.height;
+	size_t pixels = (size_t)width * height * (FRAMES+2), next = 0;
+
+	// The output is written as it leaves the pipeline
+	frame_sink raw(RAW_OUTPUT_IMG, -1, width, height, OUTPUT_FORMAT);
+	frame_sink valid(OUTPUT_IMG, FRAMES, width, height, OUTPUT_FORMAT);
+
+	processStream([&](pixel_data &p) {
+			if (next == pixels)
+				return false;
+			p = imagePixel(img, next++);
+			return true;
+		}, [&](pixel_data &p) {
+			raw.push(p);
+			valid.push(p);
+		}, width, height, HYST_MODE);
+	raw.close();
+	if (!valid.close())
+		return 1;
+
+	// Every check runs and reports, the exit code says whether all passed
+	bool pass = true;
+
+#if PPC_TEST
+	bool ppc = testPPC<1>(img, SETTLE_FRAMES+FRAMES);
+	ppc &= testPPC<2>(img, SETTLE_FRAMES+FRAMES);
+	ppc &= testPPC<4>(img, SETTLE_FRAMES+FRAMES);
+	if (!ppc)
+		std::cout << "##### Pixels per clock variants differ from processStream #####" << std::endl;
+	pass &= ppc;
+#endif
+
+#if DATAFLOW_TEST
+	if (!testDataflow(img, SETTLE_FRAMES+FRAMES))
+	{
+		std::cout << "##### Dataflow top differs from processStream #####" << std::endl;
+		pass = false;
+	}
+#endif
 
-	loadStream(INPUT_IMG, srcStream, FRAMES+2);
-	processStream(srcStream, procStream);
-	saveRawStream(procStream, dstStream, RAW_OUTPUT_IMG);
-	saveValidStream(dstStream, OUTPUT_IMG, FRAMES);
+#if BATCH_TEST
+	if (!testBatch(img, SETTLE_FRAMES+FRAMES))
+	{
+		std::cout << "##### Batch top differs from processStream #####" << std::endl;
+		pass = false;
+	}
+#endif
+
+#if CAMS_TEST
+	if (!testCams(img, SETTLE_FRAMES+FRAMES))
+	{
+		std::cout << "##### Multi-camera top differs from the single stream top #####" << std::endl;
+		pass = false;
+	}
+#endif
 
-	return 0;
+	return pass ? 0 : 1;
 }
 
@@ -6,37 +6,81 @@
 #define INC_H
 
 
-#include <stdint.h>
-#include <iostream>
-#include <hls_stream.h>
-#include <hls_video.h>
+#include <functional>
+#include <vector>
 #include <hls_opencv.h>
-#include <ap_axi_sdata.h>
+#include "canny.h"
 
 
-// Image dimensions
-#define WIDTH 1280
-#define HEIGHT 720
-
 // Number of frames for multi-frame processing
 #define FRAMES 1
 
-// Pixel and stream types
-typedef ap_axiu<32,1,1,1> pixel_data;
-typedef hls::stream<pixel_data> pixel_stream;
+// Threshold mode of the sobel stage: 0 = fixed HIGH/LOW, 1 = percentile, 2 = Otsu
+#define THRES_MODE 0
+
+// Hysteresis mode: 0 = 3x3 window, 1 = exact edge tracking, a frame late,
+// which needs a build with HYST_EXACT_ENABLE
+#define HYST_MODE 0
+#if HYST_MODE && !HYST_EXACT_ENABLE
+#error "HYST_MODE 1 needs HYST_EXACT_ENABLE"
+#endif
+
+// Depth of the FIFOs between the stages, 0 = unbounded
+#define FIFO_DEPTH 2
+
+// Stream format between the stages: 0 = 32-bit RGBA, 1 = 8-bit grey after greyscale
+#define NARROW_STREAM 1
+
+// Replace greyscale, gauss and sobel by the fused front end
+#define FUSED_FRONT 0
+
+// Check the N pixels per clock pipeline against processStream for N = 1, 2, 4,
+// always with the 3x3 window hysteresis since the PPC stages have no exact one
+#define PPC_TEST 1
+
+// Check the single dataflow top against processStream
+#define DATAFLOW_TEST 1
 
-// Stream processing function
-void greyscale( pixel_stream&,  pixel_stream&);
-void gauss(pixel_stream&,  pixel_stream&);
-int16_t sobel(pixel_stream&, pixel_stream&, uint32_t);
-void suppression(pixel_stream&,  pixel_stream&, int16_t&);
-void threshold(pixel_stream &, pixel_stream &);
-void hysteresis(pixel_stream &, pixel_stream &);
+// Check the m_axi batch top against processStream, host arrays stand in for DDR
+#define BATCH_TEST 1
+
+// Check the multi-camera top, interleaving the rows of CAMERAS views of the
+// image, against a single stream run of every view
+#define CAMS_TEST 1
+
+// Frame the tests stream in, decoded once and replayed by reference
+struct input_frame {
+	input_frame() : rgba(NULL), width(0), height(0), map(NULL), map_size(0) {}
+	~input_frame();
+
+	const uint32_t *rgba;		// packed RGBA words, red in the lowest byte
+	int width, height;
+	std::vector<uint32_t> words;	// owns rgba unless the file is mapped
+	void *map;
+	size_t map_size;
+
+private:
+	input_frame(const input_frame&);
+	input_frame& operator=(const input_frame&);
+};
 
 // Image paths
 #define INPUT_IMG  "C:/Users/HashPac/Desktop/School/Master/Q2/Reconfigurable_Computing/Lab/PYNQ-Z2_lab2020/examples/parrot.jpg"
 #define OUTPUT_IMG "C:/Users/HashPac/Desktop/School/Master/Q2/Reconfigurable_Computing/Lab/PYNQ-Z2_lab2020/examples/output.png"
 #define RAW_OUTPUT_IMG "C:/Users/HashPac/Desktop/School/Master/Q2/Reconfigurable_Computing/Lab/PYNQ-Z2_lab2020/examples/raw_output.png"
 
+// Output of the valid frames and the raw stream: a PNG of the first valid
+// frame and of the whole raw stream stacked, a PNG per frame, or every frame
+// as Y4M video or raw 8-bit greyscale
+#define OUTPUT_PNG 0
+#define OUTPUT_PNG_SEQUENCE 1
+#define OUTPUT_Y4M 2
+#define OUTPUT_RAW 3
+#define OUTPUT_FORMAT OUTPUT_PNG
+
+// Directory of the converted input frames, named by a hash of the image
+// file so that later runs skip decoding, "" to decode every run
+#define INPUT_CACHE "C:/Users/HashPac/Desktop/School/Master/Q2/Reconfigurable_Computing/Lab/PYNQ-Z2_lab2020/examples/"
+
 
 #endif // INC_H